@@ -0,0 +1,248 @@
+#include <errno.h>
+#include <cluster.h>
+#include <linux/perf_event.h>
+#include <orders.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_FLEET_COUNT (64)
+#define BENCH_MIN_TIME_NSEC (200000000LL)
+#define BENCH_DISAGREE_PERCENT (10)
+
+typedef struct
+{
+    elevator_t elevators[ELEVATOR_COUNT];
+    bool connected[ELEVATOR_COUNT];
+    cluster_view_t view; // Cluster view of elevator 0
+} fleet_t;
+
+typedef size_t (*kernel_t)(fleet_t *fleet, size_t index, size_t op);
+
+static fleet_t pristine_fleets[BENCH_FLEET_COUNT];
+static fleet_t fleets[BENCH_FLEET_COUNT];
+static volatile size_t sink;
+
+static int64_t monotonic_nsec(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (int64_t)time.tv_sec * 1000000000LL + time.tv_nsec;
+}
+
+static int counter_open(void)
+{
+    struct perf_event_attr attr = {
+        .type = PERF_TYPE_HARDWARE,
+        .size = sizeof(attr),
+        .config = PERF_COUNT_HW_CACHE_MISSES,
+        .disabled = 1,
+        .exclude_kernel = 1,
+        .exclude_hv = 1,
+    };
+    int fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    if (fd == -1)
+    {
+        return -errno;
+    }
+    return fd;
+}
+
+static void fleet_generate(fleet_t *fleet, unsigned int *seed)
+{
+    /* Every elevator starts from the same view of the calls and locks, and a few of them disagree on single floors
+     * as they would while datagrams are in flight */
+    elevator_t truth = {0};
+    for (size_t j = 0; j < FLOOR_COUNT; ++j)
+    {
+        for (elevator_direction_t direction = ELEVATOR_DIRECTION_UP; direction <= ELEVATOR_DIRECTION_DOWN; ++direction)
+        {
+            if (rand_r(seed) % 4 == 0)
+            {
+                truth.floor_states[j] |= direction_to_floor_flag_button(direction);
+                if (rand_r(seed) % 2 == 0)
+                {
+                    truth.floor_states[j] |= direction_to_floor_flag_locked(direction);
+                    truth.locking_elevator[direction][j] = rand_r(seed) % ELEVATOR_COUNT;
+                }
+            }
+        }
+    }
+
+    for (size_t i = 0; i < ELEVATOR_COUNT; ++i)
+    {
+        elevator_t *elevator = &fleet->elevators[i];
+        *elevator = truth;
+        fleet->connected[i] = true;
+        for (size_t j = 0; j < FLOOR_COUNT; ++j)
+        {
+            if (rand_r(seed) % 100 < BENCH_DISAGREE_PERCENT)
+            {
+                elevator->floor_states[j] ^= 1 << (rand_r(seed) % 5);
+            }
+            if (rand_r(seed) % 8 == 0)
+            {
+                elevator->floor_states[j] |= FLOOR_FLAG_BUTTON_CAB;
+            }
+        }
+        elevator->state = ELEVATOR_STATE_MOVING;
+        elevator->current_floor = rand_r(seed) % FLOOR_COUNT;
+        elevator->target_floor = rand_r(seed) % FLOOR_COUNT;
+        elevator->direction = rand_r(seed) % 2;
+        elevator->disabled = rand_r(seed) % 32 == 0;
+    }
+
+    cluster_view_init(&fleet->view, 0);
+    cluster_view_update_connections(&fleet->view, fleet->elevators, fleet->connected);
+}
+
+static size_t kernel_register_orders(fleet_t *fleet, size_t index, size_t op)
+{
+    (void)op;
+    register_orders(fleet->elevators, fleet->connected, index);
+    return fleet->elevators[index].floor_states[0];
+}
+
+static size_t kernel_order_is_available(fleet_t *fleet, size_t index, size_t op)
+{
+    (void)index;
+    return order_is_available(fleet->elevators, fleet->connected, op % 2, op % FLOOR_COUNT);
+}
+
+static size_t kernel_locking_scan(fleet_t *fleet, size_t index, size_t op)
+{
+    (void)index;
+    /* The up and down locking loops in elevator_run ask for every floor in the direction of travel */
+    size_t available = 0;
+    for (size_t j = 0; j < FLOOR_COUNT; ++j)
+    {
+        available += order_is_available(fleet->elevators, fleet->connected, op % 2, j);
+    }
+    return available;
+}
+
+static size_t kernel_floor_is_locked(fleet_t *fleet, size_t index, size_t op)
+{
+    (void)op;
+    return floor_is_locked(fleet->elevators, fleet->connected, index);
+}
+
+static size_t kernel_verify_locked_floors(fleet_t *fleet, size_t index, size_t op)
+{
+    return verify_locked_floors(fleet->elevators, fleet->connected, op % 2, index);
+}
+
+static size_t kernel_view_sync(fleet_t *fleet, size_t index, size_t op)
+{
+    /* A merged datagram usually changes a single floor */
+    fleet->elevators[index].floor_states[op % FLOOR_COUNT] ^= FLOOR_FLAG_BUTTON_UP;
+    cluster_view_sync(&fleet->view, fleet->elevators, index);
+    return fleet->view.button_count[ELEVATOR_DIRECTION_UP][op % FLOOR_COUNT];
+}
+
+static size_t kernel_view_locking_scan(fleet_t *fleet, size_t index, size_t op)
+{
+    (void)index;
+    size_t available = 0;
+    for (size_t j = 0; j < FLOOR_COUNT; ++j)
+    {
+        available += cluster_view_order_is_available(&fleet->view, op % 2, j);
+    }
+    return available;
+}
+
+static size_t kernel_view_floor_is_locked(fleet_t *fleet, size_t index, size_t op)
+{
+    (void)index;
+    (void)op;
+    return cluster_view_floor_is_locked(&fleet->view, &fleet->elevators[0]);
+}
+
+static void bench_run(const char *name, kernel_t kernel, int counter)
+{
+    size_t op = 0;
+    size_t result = 0;
+    int64_t time = 0;
+    uint64_t misses = 0;
+
+    while (time < BENCH_MIN_TIME_NSEC)
+    {
+        /* The kernels modify the fleets, so every pass starts from the generated states. Copying is not measured */
+        memcpy(fleets, pristine_fleets, sizeof(fleets));
+
+        if (counter >= 0)
+        {
+            ioctl(counter, PERF_EVENT_IOC_RESET, 0);
+            ioctl(counter, PERF_EVENT_IOC_ENABLE, 0);
+        }
+        int64_t start = monotonic_nsec();
+        for (size_t f = 0; f < BENCH_FLEET_COUNT; ++f)
+        {
+            for (size_t i = 0; i < ELEVATOR_COUNT; ++i)
+            {
+                result += kernel(&fleets[f], i, op++);
+            }
+        }
+        time += monotonic_nsec() - start;
+        if (counter >= 0)
+        {
+            uint64_t value = 0;
+            ioctl(counter, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(counter, &value, sizeof(value)) == sizeof(value))
+            {
+                misses += value;
+            }
+        }
+    }
+    sink = result;
+
+    if (counter >= 0)
+    {
+        printf("%-22s %6d %9d %10.1f %16.3f\n", name, FLOOR_COUNT, ELEVATOR_COUNT, (double)time / op,
+               (double)misses / op);
+    }
+    else
+    {
+        printf("%-22s %6d %9d %10.1f %16s\n", name, FLOOR_COUNT, ELEVATOR_COUNT, (double)time / op, "n/a");
+    }
+}
+
+int main(int argc, char **argv)
+{
+    (void)argv;
+    int counter = counter_open();
+    if (counter < 0)
+    {
+        fprintf(stderr, "perf_event_open failed, err = %d. Cache misses are not reported\n", -counter);
+    }
+
+    unsigned int seed = 1;
+    for (size_t f = 0; f < BENCH_FLEET_COUNT; ++f)
+    {
+        fleet_generate(&pristine_fleets[f], &seed);
+    }
+
+    /* Any argument prints the header, so the output of several benchmark executables can be concatenated */
+    if (argc > 1)
+    {
+        printf("%-22s %6s %9s %10s %16s\n", "kernel", "floors", "elevators", "ns/op", "cache-misses/op");
+    }
+    bench_run("register_orders", kernel_register_orders, counter);
+    bench_run("order_is_available", kernel_order_is_available, counter);
+    bench_run("locking_scan", kernel_locking_scan, counter);
+    bench_run("floor_is_locked", kernel_floor_is_locked, counter);
+    bench_run("verify_locked_floors", kernel_verify_locked_floors, counter);
+    bench_run("view_sync", kernel_view_sync, counter);
+    bench_run("view_locking_scan", kernel_view_locking_scan, counter);
+    bench_run("view_floor_is_locked", kernel_view_floor_is_locked, counter);
+
+    if (counter >= 0)
+    {
+        (void)close(counter);
+    }
+    return 0;
+}
@@ -0,0 +1,30 @@
+#ifndef ASSIGN_H
+#define ASSIGN_H
+
+#include <elevator.h>
+#include <stdbool.h>
+
+#define ASSIGN_NONE (255)
+
+/**
+ * @brief Assigns the outstanding hall calls of elevator @p index to the elevators that serve them soonest, as a
+ * minimum-cost matching over the estimated service times. A car that gets several calls has them queued behind each
+ * other. Calls a car already has locked cost every other car a handover penalty, so a lock only moves for a clear gain.
+ * Only the calls that can be served soonest are matched, and the others are queued on their cheapest car one by one.
+ *
+ * Every elevator computes the same assignment from the same states, but the states each node has seen differ, so two
+ * cars may both be assigned a call. The assignment only decides which calls a car tries to lock, and the lock protocol
+ * settles the conflict: when two cars have locked the same call, every node keeps the lock of the lower elevator index,
+ * and a car only goes for a call once every connected elevator of its zone records it as the holder
+ *
+ * @param elevators array of elevators with length equal to ELEVATOR_COUNT
+ * @param connected whether each elevator takes part in the decisions, array with length equal to ELEVATOR_COUNT
+ * @param index index of the local elevator, whose calls are assigned
+ * @param assignment destination of the assigned elevator of every hall call by direction and floor, ASSIGN_NONE for
+ * floors without an outstanding call. Calls a car is committed to, as its target or with its door open, are assigned
+ * to that car
+ */
+void assign_calls(const elevator_t *elevators, const bool *connected, const size_t index,
+                  uint8_t assignment[2][FLOOR_COUNT]);
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef CADENCE_H
+#define CADENCE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef enum
+{
+    CADENCE_SIGNAL_BUTTONS = 0,
+    CADENCE_SIGNAL_FLOOR,
+    CADENCE_SIGNAL_OBSTRUCTION,
+    CADENCE_SIGNAL_COUNT,
+} cadence_signal_t;
+
+/**
+ * @brief Polling schedule of the hardware signals of one elevator. Every signal has its own period in every elevator
+ * state, so a moving car watches its floor sensor and an idle car is hardly polled at all
+ */
+typedef struct
+{
+    int64_t polled[CADENCE_SIGNAL_COUNT]; // CLOCK_MONOTONIC time of the last poll in nanoseconds, 0 if never
+} cadence_t;
+
+/**
+ * @brief Checks whether @p signal is due to be polled
+ *
+ * @param cadence polling schedule
+ * @param signal hardware signal
+ * @param state elevator state
+ * @param now current CLOCK_MONOTONIC time in nanoseconds
+ * @return true if the signal should be polled now
+ */
+bool cadence_is_due(const cadence_t *cadence, cadence_signal_t signal, uint8_t state, int64_t now);
+
+/**
+ * @brief Records that @p signal was polled
+ *
+ * @param cadence polling schedule
+ * @param signal hardware signal
+ * @param now current CLOCK_MONOTONIC time in nanoseconds
+ */
+void cadence_polled(cadence_t *cadence, cadence_signal_t signal, int64_t now);
+
+/**
+ * @brief Gets the time the next signal is due
+ *
+ * @param cadence polling schedule
+ * @param state elevator state
+ * @return CLOCK_MONOTONIC time in nanoseconds, INT64_MAX if no signal is polled in @p state
+ */
+int64_t cadence_next(const cadence_t *cadence, uint8_t state);
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef CLUSTER_H
+#define CLUSTER_H
+
+#include <elevator.h>
+#include <orders.h>
+#include <stdbool.h>
+
+#define CLUSTER_VIEW_NO_HOLDER (255)
+
+/**
+ * @brief Per-floor aggregates over the connected elevators as seen by one local elevator. The aggregates are updated
+ * when the state of an elevator changes or an elevator connects or disconnects, so the decisions are lookups
+ */
+typedef struct
+{
+    uint8_t floor_states[ELEVATOR_COUNT][FLOOR_COUNT];         // States as last synchronized
+    uint8_t locking_elevator[ELEVATOR_COUNT][2][FLOOR_COUNT]; // Lock holders as last synchronized
+    bool connected[ELEVATOR_COUNT];
+    uint8_t connected_count;
+    uint8_t button_count[2][FLOOR_COUNT]; // Connected elevators with the hall call registered
+    uint8_t locked_count[2][FLOOR_COUNT]; // Connected elevators with the hall call locked
+    uint8_t holder[2][FLOOR_COUNT];       // Lock holder every connected elevator agrees on, or CLUSTER_VIEW_NO_HOLDER
+    size_t index;
+} cluster_view_t;
+
+/**
+ * @brief Initializes an empty cluster view for elevator @p index
+ *
+ * @param view cluster view
+ * @param index index of the local elevator
+ */
+void cluster_view_init(cluster_view_t *view, const size_t index);
+
+/**
+ * @brief Adds elevators that connected and removes elevators that disconnected since the last call
+ *
+ * @param view cluster view
+ * @param elevators array of elevators with length equal to ELEVATOR_COUNT
+ * @param connected whether each elevator takes part in the decisions, array with length equal to ELEVATOR_COUNT
+ */
+void cluster_view_update_connections(cluster_view_t *view, const elevator_t *elevators, const bool *connected);
+
+/**
+ * @brief Updates the aggregates of the floors where elevator @p i changed since it was last synchronized
+ *
+ * @param view cluster view
+ * @param elevators array of elevators with length equal to ELEVATOR_COUNT
+ * @param i index of the elevator that may have changed
+ */
+void cluster_view_sync(cluster_view_t *view, const elevator_t *elevators, const size_t i);
+
+/**
+ * @brief Gets the hall calls every connected elevator has registered at @p floor
+ *
+ * @param view cluster view
+ * @param floor floor index
+ * @return FLOOR_FLAG_BUTTON_UP and FLOOR_FLAG_BUTTON_DOWN bits
+ */
+uint8_t cluster_view_calls(const cluster_view_t *view, const uint8_t floor);
+
+/**
+ * @brief Same as order_is_available, answered from the aggregates
+ *
+ * @param view cluster view
+ * @param direction direction of the hall call
+ * @param floor floor of the hall call
+ * @return true if the call can be locked
+ */
+bool cluster_view_order_is_available(const cluster_view_t *view, elevator_direction_t direction, const uint8_t floor);
+
+/**
+ * @brief Same as floor_is_locked, answered from the aggregates
+ *
+ * @param view cluster view
+ * @param elevator state of the local elevator
+ * @return true if the elevator should stop
+ */
+bool cluster_view_floor_is_locked(const cluster_view_t *view, const elevator_t *elevator);
+
+#endif
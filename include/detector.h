@@ -0,0 +1,67 @@
+#ifndef DETECTOR_H
+#define DETECTOR_H
+
+#include <elevator.h>
+#include <stdbool.h>
+
+#ifndef PHI_THRESHOLD
+#define PHI_THRESHOLD 8.0
+#endif
+
+#define DETECTOR_WINDOW (64)
+
+typedef struct
+{
+    double intervals[DETECTOR_WINDOW]; // Seconds between the last heartbeats
+    double sum;
+    double sum_squares;
+    size_t count;
+    size_t next;
+    double last_arrival; // CLOCK_MONOTONIC seconds
+    bool heard;
+} detector_peer_t;
+
+/**
+ * @brief Phi accrual failure detector. Learns the distribution of the time between heartbeats of every elevator and
+ * expresses how suspicious the silence since the last heartbeat is as phi = -log10(P(heartbeat arrives this late))
+ */
+typedef struct
+{
+    detector_peer_t peers[ELEVATOR_COUNT];
+} failure_detector_t;
+
+/**
+ * @brief Initializes the failure detector. Every elevator is treated as if it was heard from now
+ *
+ * @param detector failure detector
+ */
+void detector_init(failure_detector_t *detector);
+
+/**
+ * @brief Records a heartbeat, meaning any state received, from elevator @p i
+ *
+ * @param detector failure detector
+ * @param i elevator index
+ */
+void detector_heartbeat(failure_detector_t *detector, const size_t i);
+
+/**
+ * @brief Gets the suspicion level of elevator @p i
+ *
+ * @param detector failure detector
+ * @param i elevator index
+ * @return phi, 0 for no suspicion and growing without bound with the time since the last heartbeat
+ */
+double detector_phi(const failure_detector_t *detector, const size_t i);
+
+/**
+ * @brief Decides which elevators take part in the decisions of elevator @p index. An elevator takes part if it is
+ * in the same zone and its phi is below PHI_THRESHOLD
+ *
+ * @param detector failure detector
+ * @param connected array with length equal to ELEVATOR_COUNT that receives the decision for every elevator
+ * @param index index of the local elevator
+ */
+void detector_connections(const failure_detector_t *detector, bool *connected, const size_t index);
+
+#endif
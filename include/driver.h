@@ -13,6 +13,8 @@
 
 #define ENOFLOOR 41 // 41 is not an error code defined in the posix standard, so I will use it for my own error code
 
+#define DRIVER_TIMEOUT_MS (100) // A hardware server that does not answer a request within this time is considered lost
+
 typedef enum
 {
     BUTTON_TYPE_HALL_UP = 0,
@@ -30,13 +32,39 @@ typedef enum
 typedef int socket_t;
 
 /**
- * @brief Initializes a socket connected to an elevator
+ * @brief Initializes a socket and starts connecting it to an elevator without waiting for the connection. Requests
+ * fail with -ENOTCONN until driver_connect reports the connection up. A first attempt that fails is retried by
+ * driver_connect on the same socket
  *
  * @param address address of the elevator
- * @return socket
+ * @return socket or error code
+ * @retval socket, negative error code if no socket could be created
  */
 socket_t driver_init(const struct sockaddr_in *address);
 
+/**
+ * @brief Takes over a socket that is already connected to an elevator, as the standby does from a failed primary. A
+ * socket whose connection was shut down, because the primary reconnected since handing it over, is reconnected by
+ * driver_connect
+ *
+ * @param sock elevator socket
+ * @param address address of the elevator, used to reconnect
+ * @return error code
+ * @retval 0 on success, otherwise negative error code
+ */
+int driver_resume(socket_t sock, const struct sockaddr_in *address);
+
+/**
+ * @brief Advances the connection of @p sock without blocking. A connection lost by a failed request is reconnected,
+ * with a backoff that grows while the server does not answer. Called once per control loop iteration
+ *
+ * @param sock elevator socket
+ * @return connection state
+ * @retval 1 if the connection came up in this call and the hardware has to be set up again, 0 if it is up, negative
+ * error code while it is down
+ */
+int driver_connect(socket_t sock);
+
 /**
  * @brief Sets the motor direction of an elevator to @p direction
  *
@@ -97,6 +125,16 @@ int driver_get_button_signals(socket_t sock, uint8_t *floor_states);
  */
 int driver_get_floor_sensor_signal(socket_t sock);
 
+/**
+ * @brief Receives button signals into @p floor_states and the floor sensor signal in a single exchange
+ *
+ * @param sock elevator socket
+ * @param floor_states byte array with size equal to FLOOR_COUNT
+ * @return floor index or error code
+ * @retval floor index, negative error code on failure or between floors
+ */
+int driver_get_inputs(socket_t sock, uint8_t *floor_states);
+
 /**
  * @brief Receives obstruction signal
  *
@@ -0,0 +1,73 @@
+#ifndef DWELL_H
+#define DWELL_H
+
+#include <elevator.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief Door dwell of one elevator. The door stays open for as long as the stop is expected to need: shorter when
+ * passengers only leave, and at hall calls as long as boarding took at that floor recently. Presses of cab buttons and
+ * the obstruction switch while the door is open show boarding is still going on and hold it a little longer
+ */
+typedef struct
+{
+    int64_t open_time;                 // CLOCK_MONOTONIC time the door opened in nanoseconds
+    int64_t close_time;                // CLOCK_MONOTONIC time the door closes unless it is held
+    int64_t activity_time;             // Last boarding activity during the stop, 0 if there was none
+    uint32_t boarding_ms[FLOOR_COUNT]; // Learned time from opening the door to the last boarding activity
+    uint8_t floor;
+    bool boarding; // Whether the stop serves a hall call, so passengers board
+    bool obstructed;
+} dwell_t;
+
+/**
+ * @brief Initializes the learned boarding times
+ *
+ * @param dwell door dwell
+ */
+void dwell_init(dwell_t *dwell);
+
+/**
+ * @brief Opens the door at the current floor of @p elevator and sets when it closes
+ *
+ * @param dwell door dwell
+ * @param elevator local elevator
+ * @param index index of the local elevator
+ * @param now current CLOCK_MONOTONIC time in nanoseconds
+ */
+void dwell_open(dwell_t *dwell, const elevator_t *elevator, const size_t index, int64_t now);
+
+/**
+ * @brief Records boarding activity, such as a cab button pressed, while the door is open
+ *
+ * @param dwell door dwell
+ * @param now current CLOCK_MONOTONIC time in nanoseconds
+ */
+void dwell_activity(dwell_t *dwell, int64_t now);
+
+/**
+ * @brief Records the obstruction switch. The door is held while obstructed and closes shortly after it clears
+ *
+ * @param dwell door dwell
+ * @param obstructed obstruction signal
+ * @param now current CLOCK_MONOTONIC time in nanoseconds
+ */
+void dwell_obstruction(dwell_t *dwell, bool obstructed, int64_t now);
+
+/**
+ * @brief Gets the time the door closes
+ *
+ * @param dwell door dwell
+ * @return CLOCK_MONOTONIC time in nanoseconds, INT64_MAX while the door is obstructed
+ */
+int64_t dwell_deadline(const dwell_t *dwell);
+
+/**
+ * @brief Closes the door and learns the boarding time of the stop
+ *
+ * @param dwell door dwell
+ */
+void dwell_close(dwell_t *dwell);
+
+#endif
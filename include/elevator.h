@@ -3,6 +3,13 @@
 
 #include <driver.h>
 #include <inttypes.h>
+#include <stdbool.h>
+
+#ifndef ZONE_SIZE
+#define ZONE_SIZE ELEVATOR_COUNT
+#endif
+
+#define ZONE_COUNT ((ELEVATOR_COUNT + ZONE_SIZE - 1) / ZONE_SIZE)
 
 typedef struct
 {
@@ -13,22 +20,28 @@ typedef struct
     uint8_t target_floor;
     uint8_t direction;
     uint8_t disabled;
+    uint16_t travel_time_ms;        // Learned time to travel one floor
+    uint16_t door_time_ms;          // Learned time from the door opening until it closes
+    uint16_t eta_ms[FLOOR_COUNT];   // Estimated time to every pending stop, UINT16_MAX where there is none
 } elevator_t;
 
 typedef struct
 {
     elevator_t elevators[ELEVATOR_COUNT];
-    socket_t elevator_socket;
+    socket_t elevator_sockets[ELEVATOR_COUNT];
     socket_t peer_socket;
 } system_state_t;
 
 /**
- * @brief Runs the elevator
+ * @brief Runs the elevators with index @p index up to, but not including, @p index + @p count in a single control loop
  *
  * @param system sockets and the state of the elevators
- * @param ports array of ports with length equal to ELEVATOR_COUNT
- * @param index index of the elevator to run
+ * @param ports seed port of every elevator, array with length equal to ELEVATOR_COUNT
+ * @param index index of the first elevator to run
+ * @param count number of elevators to run
+ * @param resume whether to continue from the state and hardware of a failed primary instead of starting up
  */
-void elevator_run(system_state_t *system, const uint16_t *ports, const size_t index);
+void elevator_run(system_state_t *system, const uint16_t *ports, const size_t index, const size_t count,
+                  const bool resume);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,51 @@
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#include <elevator.h>
+#include <peer_message.h>
+#include <receiver.h>
+#include <stdbool.h>
+
+/**
+ * @brief Starts tracking the hall calls and locks of the elevators @p first to @p first + @p count - 1
+ *
+ * @param elevators array of elevators with length equal to ELEVATOR_COUNT. Calls already known are not sent as events
+ * @param first index of the first elevator run by this process
+ * @param count number of elevators run by this process
+ */
+void events_init(const elevator_t *elevators, size_t first, size_t count);
+
+/**
+ * @brief Numbers a state of the process that is about to be sent to the peers. Events queued afterwards are stamped
+ * with it
+ *
+ * @return sequence of the state, starting at 1
+ */
+uint32_t events_state_sent(void);
+
+/**
+ * @brief Queues an event for every hall call registered or lock claimed by elevator @p index since the last call. Each
+ * event waits for an acknowledgement from the peers in @p recipients
+ *
+ * @param elevator state of elevator @p index
+ * @param index index of a local elevator
+ * @param recipients peers the events are sent to, array with length equal to ELEVATOR_COUNT
+ */
+void events_track(const elevator_t *elevator, size_t index, const bool *recipients);
+
+/**
+ * @brief Gets the next queued event that is new or whose retransmission timed out. Events are dropped once every
+ * recipient acknowledged them, a recipient disconnected, or the call was completed
+ *
+ * @param snapshot peer snapshot holding the acknowledgements
+ * @param elevators array of elevators with length equal to ELEVATOR_COUNT
+ * @param connected whether each peer is still connected, array with length equal to ELEVATOR_COUNT
+ * @param event destination of the event
+ * @param recipients destination of the peers that did not acknowledge it yet, array with length equal to
+ * ELEVATOR_COUNT
+ * @return true if an event is due, false when there is nothing more to send
+ */
+bool events_next(const peer_snapshot_t *snapshot, const elevator_t *elevators, const bool *connected,
+                 peer_event_t *event, bool *recipients);
+
+#endif
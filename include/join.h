@@ -0,0 +1,59 @@
+#ifndef JOIN_H
+#define JOIN_H
+
+#include <elevator.h>
+#include <netinet/in.h>
+#include <peer_message.h>
+#include <receiver.h>
+#include <stdbool.h>
+
+/**
+ * @brief Starts the join handshake of the elevators @p first to @p first + @p count - 1
+ *
+ * @param first index of the first elevator run by this process
+ * @param count number of elevators run by this process
+ * @param synced whether the state is already complete, as after taking over from a failed primary
+ */
+void join_init(size_t first, size_t count, bool synced);
+
+/**
+ * @brief Checks whether the join handshake is over. Until then no call may be locked
+ *
+ * @return true if a snapshot was installed, or no member in the zone had one to give
+ */
+bool join_is_synced(void);
+
+/**
+ * @brief Installs the snapshot answering the request in progress once it arrives. Remote elevators that were not heard
+ * from directly yet take their state from the snapshot, and local elevators take back the cab calls the members still
+ * knew of. Gives up after JOIN_TIMEOUT_NSEC, or when no member of the zone is found
+ *
+ * @param snapshot peer snapshot holding the answer
+ * @param elevators array of elevators with length equal to ELEVATOR_COUNT
+ * @param heard whether the state of each elevator was received directly, array with length equal to ELEVATOR_COUNT
+ */
+void join_update(const peer_snapshot_t *snapshot, elevator_t *elevators, const bool *heard);
+
+/**
+ * @brief Builds the join request of this iteration, if one is due. Requests go to the live members of the zone in
+ * turn, one per process, until one of them answers
+ *
+ * @param request destination of the request
+ * @param address destination of the address to send it to
+ * @return true if a request is due
+ */
+bool join_request(peer_sync_request_t *request, struct sockaddr_in *address);
+
+/**
+ * @brief Builds the answer to the next join request that was not answered yet
+ *
+ * @param snapshot peer snapshot holding the requests
+ * @param elevators array of elevators with length equal to ELEVATOR_COUNT
+ * @param reply destination of the answer
+ * @param address destination of the address of the joining process
+ * @return true if an answer is due, false when every request is answered
+ */
+bool join_next_reply(const peer_snapshot_t *snapshot, const elevator_t *elevators, peer_sync_t *reply,
+                     struct sockaddr_in *address);
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <elevator.h>
+
+#ifndef JOURNAL_DIR
+#define JOURNAL_DIR "."
+#endif
+
+#ifndef JOURNAL_INTERVAL_MS
+#define JOURNAL_INTERVAL_MS 50
+#endif
+
+/**
+ * @brief Restores the cab calls recorded in the journal of the elevators @p index to @p index + @p count - 1, compacts
+ * the journal and starts committing it every JOURNAL_INTERVAL_MS
+ *
+ * @param index index of the first elevator run by this process
+ * @param count number of elevators run by this process
+ * @param elevators array of elevators with length equal to ELEVATOR_COUNT. Recorded calls are added to it
+ * @return error code
+ * @retval 0 on success, otherwise negative error code. Calls are then not journaled
+ */
+int journal_open(size_t index, size_t count, elevator_t *elevators);
+
+/**
+ * @brief Records the calls of elevator @p index registered or completed since the previous call. Only copies to memory,
+ * the records are written and synced by the next group commit
+ *
+ * @param index elevator index
+ * @param floor_states current floor states, array with length equal to FLOOR_COUNT
+ */
+void journal_record(size_t index, const uint8_t *floor_states);
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef LOCAL_PEER_H
+#define LOCAL_PEER_H
+
+#include <elevator.h>
+#include <stdbool.h>
+
+/**
+ * @brief Creates the shared memory ring this process publishes its elevator states in
+ *
+ * @param index index of the first elevator run by this process
+ * @param count number of elevators run by this process
+ * @return error code
+ * @retval 0 on success, otherwise negative error code
+ */
+int local_peer_init(size_t index, size_t count);
+
+/**
+ * @brief Publishes the states of the elevators run by this process to the processes on the same host
+ *
+ * @param elevators array of elevators with length equal to ELEVATOR_COUNT
+ */
+void local_peer_publish(const elevator_t *elevators);
+
+/**
+ * @brief Looks for rings published by other processes on the same host and takes a snapshot of the live ones, which
+ * local_peer_is_connected answers from until the next call. Rings that are already mapped are kept
+ */
+void local_peer_discover(void);
+
+/**
+ * @brief Checks whether elevator @p i was run by a live process on the same host at the last local_peer_discover
+ *
+ * @param i elevator index
+ * @return true if the state of @p i can be read with local_peer_read
+ */
+bool local_peer_is_connected(size_t i);
+
+/**
+ * @brief Reads the newest published state of elevator @p i
+ *
+ * @param i elevator index
+ * @param elevator destination of the state
+ * @return error code
+ * @retval 1 if a new state was read, 0 if nothing was published since the last read, negative error code if @p i is
+ * not run by a live process on the same host
+ */
+int local_peer_read(size_t i, elevator_t *elevator);
+
+#endif
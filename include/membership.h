@@ -0,0 +1,80 @@
+#ifndef MEMBERSHIP_H
+#define MEMBERSHIP_H
+
+#include <elevator.h>
+#include <inttypes.h>
+#include <netinet/in.h>
+#include <peer_message.h>
+#include <receiver.h>
+#include <stdbool.h>
+
+/**
+ * @brief Starts a new incarnation of the elevators @p first to @p first + @p count - 1. Until other members are known,
+ * gossip is announced on the seed ports
+ *
+ * @param seed_ports broadcast port of every elevator, array with length equal to ELEVATOR_COUNT
+ * @param first index of the first elevator run by this process
+ * @param count number of elevators run by this process
+ */
+void membership_init(const uint16_t *seed_ports, size_t first, size_t count);
+
+/**
+ * @brief Takes over the member list of @p snapshot. A member joins when it is first heard of or restarts, and leaves
+ * when its heartbeat has not increased for MEMBERSHIP_TIMEOUT_NSEC. Every join and leave increases the version
+ *
+ * @param snapshot peer snapshot
+ */
+void membership_update(const peer_snapshot_t *snapshot);
+
+/**
+ * @brief Checks whether elevator @p i is a live member
+ *
+ * @param i elevator index
+ * @return true if its datagrams can be sent to membership_address
+ */
+bool membership_is_live(size_t i);
+
+/**
+ * @brief Gets the address elevator @p i was last heard from
+ *
+ * @param i index of a live member
+ * @return address
+ */
+const struct sockaddr_in *membership_address(size_t i);
+
+/**
+ * @brief Gets the live member that datagrams for the process running elevator @p i are sent to, the lowest one at
+ * the same address
+ *
+ * @param i index of a live member
+ * @return index of the contact
+ */
+size_t membership_contact(size_t i);
+
+/**
+ * @brief Gets the live members
+ *
+ * @param members destination of the array of member indices, in ascending order
+ * @return number of live members
+ */
+size_t membership_live(const uint8_t **members);
+
+/**
+ * @brief Gets the version of the member list, increased on every join and leave
+ *
+ * @return version
+ */
+uint32_t membership_version(void);
+
+/**
+ * @brief Builds the gossip message of this round, if one is due. Each round goes to MEMBERSHIP_FANOUT live members in
+ * turn and to members that just joined, and to the seed ports while no other member is known
+ *
+ * @param gossip destination of the message
+ * @param size destination of the size of the message
+ * @param targets destination of the addresses to send it to, array with length equal to ELEVATOR_COUNT
+ * @return number of targets, 0 when no gossip is due
+ */
+size_t membership_gossip(peer_gossip_t *gossip, size_t *size, struct sockaddr_in *targets);
+
+#endif
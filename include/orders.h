@@ -0,0 +1,109 @@
+#ifndef ORDERS_H
+#define ORDERS_H
+
+#include <elevator.h>
+#include <stdbool.h>
+
+typedef enum
+{
+    FLOOR_FLAG_BUTTON_UP = 1,
+    FLOOR_FLAG_BUTTON_DOWN = 1 << 1,
+    FLOOR_FLAG_BUTTON_CAB = 1 << 2,
+    FLOOR_FLAG_LOCKED_UP = 1 << 3,
+    FLOOR_FLAG_LOCKED_DOWN = 1 << 4
+} floor_flags_t;
+
+typedef enum
+{
+    ELEVATOR_STATE_IDLE = 0,
+    ELEVATOR_STATE_MOVING = 1,
+    ELEVATOR_STATE_OPEN = 2,
+} elevator_state_t;
+
+typedef enum
+{
+    ELEVATOR_DIRECTION_UP = 0,
+    ELEVATOR_DIRECTION_DOWN = 1,
+} elevator_direction_t;
+
+/**
+ * @brief Gets the button flag of @p direction
+ *
+ * @param direction elevator direction
+ * @return FLOOR_FLAG_BUTTON_UP or FLOOR_FLAG_BUTTON_DOWN
+ */
+floor_flags_t direction_to_floor_flag_button(elevator_direction_t direction);
+
+/**
+ * @brief Gets the lock flag of @p direction
+ *
+ * @param direction elevator direction
+ * @return FLOOR_FLAG_LOCKED_UP or FLOOR_FLAG_LOCKED_DOWN
+ */
+floor_flags_t direction_to_floor_flag_locked(elevator_direction_t direction);
+
+/**
+ * @brief Gets the zone of elevator @p i
+ *
+ * @param i elevator index
+ * @return zone index
+ */
+size_t zone_of(const size_t i);
+
+/**
+ * @brief Merges the calls and locks of @p peer into @p elevator. A lock is released when its holder released it
+ *
+ * @param elevator local elevator
+ * @param index index of the local elevator
+ * @param peer peer elevator or zone digest. Its lock holders may be updated to the ones agreed on
+ * @param peer_index index of the peer elevator, or of the representative sending the digest
+ * @param zone zone of the digest, or ZONE_COUNT if @p peer is an elevator in the same zone
+ */
+void register_peer_orders(elevator_t *elevator, const size_t index, elevator_t *peer, const size_t peer_index,
+                          const size_t zone);
+
+/**
+ * @brief Merges the calls and locks of all connected peers into elevator @p index
+ *
+ * @param elevators array of elevators with length equal to ELEVATOR_COUNT
+ * @param connected whether each elevator takes part in the decisions, array with length equal to ELEVATOR_COUNT
+ * @param index index of the local elevator
+ */
+void register_orders(elevator_t *elevators, const bool *connected, const size_t index);
+
+/**
+ * @brief Checks whether every connected elevator agrees that elevator @p index should stop at its current floor
+ *
+ * @param elevators array of elevators with length equal to ELEVATOR_COUNT
+ * @param connected whether each elevator takes part in the decisions, array with length equal to ELEVATOR_COUNT
+ * @param index index of the local elevator
+ * @return true if the elevator should stop
+ */
+bool floor_is_locked(const elevator_t *elevators, const bool *connected, const size_t index);
+
+/**
+ * @brief Checks whether every connected elevator has registered the hall call at @p floor and none has locked it
+ *
+ * @param elevators array of elevators with length equal to ELEVATOR_COUNT
+ * @param connected whether each elevator takes part in the decisions, array with length equal to ELEVATOR_COUNT
+ * @param direction direction of the hall call
+ * @param floor floor of the hall call
+ * @return true if the call can be locked
+ */
+bool order_is_available(const elevator_t *elevators, const bool *connected, elevator_direction_t direction,
+                        uint8_t floor);
+
+/**
+ * @brief Checks whether every connected elevator agrees on the lock holder of the target floor of elevator @p index.
+ * Locks held by disconnected or disabled elevators are taken over
+ *
+ * @param elevators array of elevators with length equal to ELEVATOR_COUNT
+ * @param connected whether each elevator takes part in the decisions, array with length equal to ELEVATOR_COUNT
+ * @param direction direction of the hall call
+ * @param index index of the local elevator
+ * @return true if all connected elevators agree
+ */
+bool verify_locked_floors(elevator_t *elevators, const bool *connected, elevator_direction_t direction,
+                          const size_t index);
+
+#endif
@@ -0,0 +1,98 @@
+#ifndef PEER_MESSAGE_H
+#define PEER_MESSAGE_H
+
+#include <elevator.h>
+
+typedef enum
+{
+    PEER_MESSAGE_TYPE_STATE = 0,
+    PEER_MESSAGE_TYPE_DIGEST,
+    PEER_MESSAGE_TYPE_EVENT,
+    PEER_MESSAGE_TYPE_ACK,
+    PEER_MESSAGE_TYPE_GOSSIP,
+    PEER_MESSAGE_TYPE_SYNC_REQUEST,
+    PEER_MESSAGE_TYPE_SYNC,
+} peer_message_type_t;
+
+#define PEER_EVENT_SLOTS (16) // Events of a process that can wait for acknowledgements at the same time
+
+typedef struct
+{
+    uint8_t type;
+    uint8_t first_index;
+    uint8_t count;
+    uint32_t sequence; // States sent by the process, starting at 1
+    elevator_t elevators[ELEVATOR_COUNT];
+} peer_message_t;
+
+typedef struct
+{
+    uint8_t type;
+    uint8_t index; // Representative sending the digest
+    uint8_t floor_states[FLOOR_COUNT];
+    uint8_t locking_elevator[2][FLOOR_COUNT];
+} zone_digest_t;
+
+/* A new hall call or lock claim, sent the moment it happens and retransmitted until every peer acknowledged it. Every
+ * state sent after the event holds the change too, so an event is dropped once a newer state of its elevator arrived */
+typedef struct
+{
+    uint8_t type;
+    uint8_t index; // Elevator whose state changed
+    uint8_t floor;
+    uint8_t floor_state; // Hall call and lock flags of the floor
+    uint8_t locking_elevator[2];
+    uint32_t sequence;       // Per process, starting at 1
+    uint32_t state_sequence; // Sequence of the last state the process sent before the event
+} peer_event_t;
+
+typedef struct
+{
+    uint8_t type;
+    uint8_t first_index; // Elevators of the acknowledging process
+    uint8_t count;
+    uint32_t sequence;
+} peer_ack_t;
+
+/* Membership entry. Newer incarnations, and newer heartbeats of the same incarnation, replace older ones */
+typedef struct
+{
+    uint8_t index;
+    uint8_t reserved;
+    uint16_t port;        // Network byte order. 0 for the elevators of the sender, which are at its source address
+    uint32_t address;     // Network byte order
+    uint64_t incarnation; // Start time of the process running the elevator in ns, 0 if the elevator is not known
+    uint32_t heartbeat;   // Increased by the process running the elevator every gossip round
+} gossip_member_t;
+
+typedef struct
+{
+    uint8_t type;
+    uint8_t first_index; // Elevators of the sender
+    uint8_t count;
+    uint8_t member_count;
+    gossip_member_t members[ELEVATOR_COUNT];
+} peer_gossip_t;
+
+/* Join handshake. A starting process asks a live member for everything it knows before it locks any call. Every
+ * attempt has a new nonce, so a retransmitted request is answered again */
+typedef struct
+{
+    uint8_t type;
+    uint8_t first_index; // Elevators of the joining process
+    uint8_t count;
+    uint32_t nonce;
+} peer_sync_request_t;
+
+typedef struct
+{
+    uint8_t type;
+    uint8_t first_index; // Elevators of the answering process
+    uint8_t count;
+    uint8_t ready;    // 0 if the answering process is still joining itself, and has no snapshot to give
+    uint32_t nonce;   // Of the request answered
+    uint32_t version; // Member list version of the answering process when it took the snapshot
+    elevator_t elevators[ELEVATOR_COUNT];
+} peer_sync_t;
+
+#endif
@@ -8,10 +8,21 @@
  * @brief Initializes the process module
  *
  * @param is_primary whether to initialize the primary or backup
- * @param index elevator index
+ * @param index index of the first elevator run by this process
+ * @param count number of elevators run by this process
  * @return error code
  * @retval 0 on success, otherwise negative error code
  */
-int process_init(bool is_primary, size_t index);
+int process_init(bool is_primary, size_t index, size_t count);
+
+/**
+ * @brief Runs the control loop on the inputs recorded in a trace, without hardware, peers or backup
+ *
+ * @param path trace file
+ * @param realtime whether to replay with the recorded timing, or as fast as possible
+ * @return error code
+ * @retval 0 when the end of the trace is reached, otherwise negative error code
+ */
+int process_replay(const char *path, bool realtime);
 
 #endif
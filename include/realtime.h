@@ -0,0 +1,40 @@
+#ifndef REALTIME_H
+#define REALTIME_H
+
+#include <stdint.h>
+
+#ifndef REALTIME_PRIORITY
+#define REALTIME_PRIORITY 50
+#endif
+
+/**
+ * @brief Enables the real-time mode for the control loop started later by this process
+ *
+ * @param cpu CPU to run the control loop on, or -1 to disable the real-time mode
+ * @return error code
+ * @retval 0 on success, -EINVAL if @p cpu does not exist
+ */
+int realtime_configure(int cpu);
+
+/**
+ * @brief Gets the CPU set with realtime_configure
+ *
+ * @return CPU, or -1 when the real-time mode is disabled
+ */
+int realtime_cpu(void);
+
+/**
+ * @brief Moves the calling thread to the configured CPU with SCHED_FIFO, locks the memory of the process and prefaults
+ * the stack. Steps that are not permitted are skipped with a warning. Does nothing when the real-time mode is disabled
+ */
+void realtime_enter(void);
+
+/**
+ * @brief Records how late the control loop woke up from a wait that ran until its timeout, publishes it to the
+ * statistics and logs the worst one every 10 s. Does nothing when the real-time mode is disabled
+ *
+ * @param deadline CLOCK_MONOTONIC time in nanoseconds the wait was to end
+ */
+void realtime_woke(int64_t deadline);
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef RECEIVER_H
+#define RECEIVER_H
+
+#include <elevator.h>
+#include <peer_message.h>
+#include <stdbool.h>
+
+/**
+ * @brief Newest peer states, zone digests, event acknowledgements, membership and join handshakes received over UDP.
+ * The counters tell which entries changed since an earlier snapshot
+ */
+typedef struct
+{
+    uint32_t state_counts[ELEVATOR_COUNT]; // States received from each elevator
+    elevator_t elevators[ELEVATOR_COUNT];
+    uint32_t digest_counts[ZONE_COUNT]; // Digests received from each zone
+    zone_digest_t digests[ZONE_COUNT];
+    uint32_t acks[ELEVATOR_COUNT][PEER_EVENT_SLOTS]; // Newest event sequence acknowledged by each elevator, by slot
+    gossip_member_t members[ELEVATOR_COUNT];         // Newest membership entry of each elevator, with its address
+    peer_sync_request_t sync_requests[ELEVATOR_COUNT]; // Newest join request by the first index of the joining process
+    struct sockaddr_in sync_sources[ELEVATOR_COUNT];   // Address each join request came from
+    uint32_t sync_count; // Join answers received
+    peer_sync_t sync;    // Newest join answer
+} peer_snapshot_t;
+
+/**
+ * @brief Starts receiving peer datagrams on a dedicated thread. Datagrams other than gossip are only accepted from the
+ * addresses of known members. While a trace is recorded or replayed, datagrams are
+ * instead received on the calling thread by receiver_snapshot, so the trace holds them in control loop order
+ *
+ * @param sock peer socket
+ * @param first index of the first elevator run by this process
+ * @param count number of elevators run by this process
+ * @return error code
+ * @retval 0 on success, otherwise negative error code. Datagrams are then received by receiver_snapshot
+ */
+int receiver_start(socket_t sock, size_t first, size_t count);
+
+/**
+ * @brief Takes a snapshot of the newest peer states. The snapshot is consistent across the whole fleet and is not
+ * written until the next call
+ *
+ * @return snapshot
+ */
+const peer_snapshot_t *receiver_snapshot(void);
+
+/**
+ * @brief Waits until a snapshot newer than the last one taken may be available, or until @p timeout has passed.
+ * Returns at once while a trace is replayed
+ *
+ * @param timeout maximum wait in nanoseconds
+ * @return true if the wait ran until @p timeout
+ */
+bool receiver_wait(int64_t timeout);
+
+#endif
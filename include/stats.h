@@ -0,0 +1,102 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <elevator.h>
+#include <stdatomic.h>
+
+#define STATS_MAGIC (0x454c5354) // "ELST"
+#define STATS_VERSION (2)
+#define STATS_NAME_FORMAT ("/elevator-stats-%zu") // Followed by the index of the first elevator of the process
+
+typedef struct
+{
+    uint32_t driver_rtt_ns;     // Smoothed round trip time of the input poll of the hardware server
+    uint32_t driver_rtt_max_ns; // Worst round trip time since the start of the process
+    uint8_t state;
+    uint8_t current_floor;
+    uint8_t target_floor;
+    uint8_t direction;
+    uint8_t disabled;
+    uint8_t hall_calls;      // Hall calls known to the elevator
+    uint8_t cab_calls;       // Cab calls of the elevator
+    uint8_t connected_peers; // Elevators it takes decisions with, itself included
+} stats_elevator_t;
+
+/**
+ * @brief Live statistics of a process, published in shared memory. Only the process writes it, with plain stores of
+ * naturally aligned fields, so readers see every field whole but not necessarily consistent with the other fields. The
+ * counters are also written by the receive thread, so they are atomic
+ */
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    int32_t pid;
+    uint8_t first_index;
+    uint8_t count;
+    int64_t heartbeat_ns;          // CLOCK_MONOTONIC time of the last control loop iteration
+    _Atomic uint64_t loop_count;   // Control loop iterations
+    uint32_t loop_ns;              // Smoothed duration of an iteration
+    uint32_t loop_max_ns;          // Worst duration of an iteration since the start of the process
+    _Atomic uint64_t datagrams_in; // Valid peer datagrams received
+    _Atomic uint64_t datagrams_out;
+    uint32_t wakeup_latency_ns;     // Smoothed lateness of the control loop waking up from a wait in real-time mode
+    uint32_t wakeup_latency_max_ns; // Worst wake-up latency since the start of the process
+    stats_elevator_t elevators[ELEVATOR_COUNT]; // By elevator index, only the ones run by the process are written
+} stats_segment_t;
+
+/**
+ * @brief Creates the statistics segment of the process. Until it is created, statistics are kept in private memory
+ *
+ * @param index index of the first elevator run by this process
+ * @param count number of elevators run by this process
+ * @return error code
+ * @retval 0 on success, otherwise negative error code
+ */
+int stats_init(size_t index, size_t count);
+
+/**
+ * @brief Marks the start of a control loop iteration, after the wait for work, so the loop duration only counts work
+ */
+void stats_loop_begin(void);
+
+/**
+ * @brief Marks the end of a control loop iteration
+ */
+void stats_loop(void);
+
+/**
+ * @brief Counts a valid datagram received from a peer
+ */
+void stats_datagram_in(void);
+
+/**
+ * @brief Counts a datagram sent to a peer
+ */
+void stats_datagram_out(void);
+
+/**
+ * @brief Records a round trip to the hardware server of elevator @p index
+ *
+ * @param index elevator index
+ * @param rtt_ns round trip time in nanoseconds
+ */
+void stats_driver_rtt(size_t index, int64_t rtt_ns);
+
+/**
+ * @brief Records how late the control loop woke up from a wait
+ *
+ * @param latency_ns latency in nanoseconds
+ */
+void stats_wakeup_latency(int64_t latency_ns);
+
+/**
+ * @brief Publishes the state of elevator @p index
+ *
+ * @param index elevator index
+ * @param elevator elevator state
+ * @param connected_peers number of elevators it takes decisions with
+ */
+void stats_elevator(size_t index, const elevator_t *elevator, uint8_t connected_peers);
+
+#endif
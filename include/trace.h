@@ -0,0 +1,135 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <elevator.h>
+#include <stdbool.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <time.h>
+
+/**
+ * A trace holds every input of the control loop in the order it was read: hardware replies, peer datagrams, peer
+ * states from shared memory and clock readings. Replaying it feeds the same inputs back, so the control loop takes the
+ * same decisions regardless of the replay speed. Outputs are discarded while replaying
+ */
+
+typedef enum
+{
+    TRACE_EVENT_STATE = 0, // Elevator states at the start of the control loop
+    TRACE_EVENT_DRIVER,    // Reply from the hardware server
+    TRACE_EVENT_DATAGRAM,  // Peer datagram, or the error ending a receive loop
+    TRACE_EVENT_SHARED,    // Peer state read from shared memory
+    TRACE_EVENT_CLOCK,     // Clock reading
+    TRACE_EVENT_LINK,      // State of a hardware connection
+    TRACE_EVENT_LOCAL,     // Elevators run by live processes on the same host
+} trace_event_type_t;
+
+/**
+ * @brief Starts recording the inputs of the elevators @p index to @p index + @p count - 1 to @p path
+ *
+ * @param path trace file, truncated if it exists
+ * @param index index of the first elevator run by this process
+ * @param count number of elevators run by this process
+ * @return error code
+ * @retval 0 on success, otherwise negative error code
+ */
+int trace_record_open(const char *path, size_t index, size_t count);
+
+/**
+ * @brief Opens the trace at @p path for replay
+ *
+ * @param path trace file
+ * @param realtime whether to deliver the inputs with their recorded timing, or as fast as possible
+ * @param index set to the index of the first recorded elevator
+ * @param count set to the number of recorded elevators
+ * @return error code
+ * @retval 0 on success, otherwise negative error code
+ */
+int trace_replay_open(const char *path, bool realtime, size_t *index, size_t *count);
+
+/**
+ * @brief Flushes the recorded events, or logs the replay statistics, and closes the trace
+ */
+void trace_close(void);
+
+/**
+ * @brief Checks whether a trace is being replayed
+ *
+ * @return true while replaying, also after the end of the trace has been reached
+ */
+bool trace_is_replaying(void);
+
+/**
+ * @brief Checks whether a trace is being recorded
+ *
+ * @return true while recording
+ */
+bool trace_is_recording(void);
+
+/**
+ * @brief Checks whether the replay has reached the end of the trace
+ *
+ * @return true once every event has been replayed
+ */
+bool trace_is_finished(void);
+
+/**
+ * @brief Records an input, if recording
+ *
+ * @param type event type
+ * @param data input bytes
+ * @param size size of @p data
+ * @param result return value of the call that produced the input, negative error code on failure
+ */
+void trace_record(trace_event_type_t type, const void *data, size_t size, int32_t result);
+
+/**
+ * @brief Replays the next input, which must be of type @p type
+ *
+ * @param type event type
+ * @param data destination of the input bytes
+ * @param size size of @p data
+ * @return recorded return value, or -ENODATA at the end of the trace and if the trace diverges
+ */
+int32_t trace_replay(trace_event_type_t type, void *data, size_t size);
+
+/**
+ * @brief Flushes the events recorded so far, called once per control loop iteration
+ */
+void trace_flush(void);
+
+/**
+ * @brief Records or replays the elevator states at the start of the control loop
+ *
+ * @param elevators array of elevators with length equal to ELEVATOR_COUNT
+ */
+void trace_state(elevator_t *elevators);
+
+/**
+ * @brief recv that is recorded or replayed
+ */
+ssize_t trace_recv(int sock, void *buffer, size_t size, int flags);
+
+/**
+ * @brief send that is discarded while replaying
+ */
+ssize_t trace_send(int sock, const void *buffer, size_t size, int flags);
+
+/**
+ * @brief recvfrom of an AF_INET datagram that is recorded or replayed
+ */
+ssize_t trace_recvfrom(int sock, void *buffer, size_t size, int flags, struct sockaddr *address,
+                       socklen_t *address_size);
+
+/**
+ * @brief sendto that is discarded while replaying
+ */
+ssize_t trace_sendto(int sock, const void *buffer, size_t size, int flags, const struct sockaddr *address,
+                     socklen_t address_size);
+
+/**
+ * @brief clock_gettime that is recorded or replayed
+ */
+int trace_clock_gettime(clockid_t clock, struct timespec *time);
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef TRAVEL_H
+#define TRAVEL_H
+
+#include <elevator.h>
+#include <orders.h>
+#include <time.h>
+
+#define TRAVEL_ETA_NONE (UINT16_MAX)
+
+/**
+ * @brief Samples in a row that were discarded as outliers of an estimate
+ */
+typedef struct
+{
+    uint8_t count;
+    uint16_t least; // Smallest sample of the run in milliseconds
+} travel_outliers_t;
+
+/**
+ * @brief Local measurements in progress for the travel time model. The learned model itself is part of elevator_t so
+ * it is shared with the peers and survives a restart through the shared memory
+ */
+typedef struct
+{
+    struct timespec segment_start; // Arrival at or departure from segment_floor
+    struct timespec door_start;
+    int segment_floor;             // -1 when no floor-to-floor segment is being measured
+    uint8_t state;                 // Elevator state at the previous observation
+    int floor_signal;              // Floor sensor at the previous observation
+    travel_outliers_t floor_outliers;
+    travel_outliers_t door_outliers;
+} travel_tracker_t;
+
+/**
+ * @brief Initializes the tracker and the model of @p elevator if it has not learned anything yet
+ *
+ * @param tracker travel tracker
+ * @param elevator local elevator
+ */
+void travel_init(travel_tracker_t *tracker, elevator_t *elevator);
+
+/**
+ * @brief Learns from the floor sensor and state transitions since the previous call, and updates the ETA of every
+ * pending stop of @p elevator
+ *
+ * @param tracker travel tracker
+ * @param elevator local elevator
+ * @param floor_signal floor sensor reading, negative between floors
+ * @param index index of the local elevator
+ */
+void travel_observe(travel_tracker_t *tracker, elevator_t *elevator, const int floor_signal, const size_t index);
+
+/**
+ * @brief Estimates how long @p elevator needs to reach @p floor if it was given a new stop there, using its
+ * published model and pending stops. A call in the other direction than the elevator is moving waits for all of them
+ *
+ * @param elevator any elevator, local or peer
+ * @param floor floor index
+ * @param direction direction of the call
+ * @return estimate in milliseconds
+ */
+uint32_t travel_estimate(const elevator_t *elevator, const uint8_t floor, const elevator_direction_t direction);
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef URING_H
+#define URING_H
+
+#include <elevator.h>
+#include <netinet/ip.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#define URING_EXCHANGE_MAX (FLOOR_COUNT * 3 + 1) // Requests of the largest hardware poll
+
+/**
+ * @brief Sets up the io_uring backend. Until it is set up, and if this fails, all I/O uses blocking system calls
+ *
+ * @return error code
+ * @retval 0 on success, -ENOSYS if built without USE_IO_URING, otherwise negative error code
+ */
+int uring_init(void);
+
+/**
+ * @brief Checks whether the io_uring backend is set up
+ *
+ * @return true if I/O goes through the ring
+ */
+bool uring_is_enabled(void);
+
+/**
+ * @brief Writes @p prefix on the stream @p sock, then writes each of @p count requests and reads its reply in its
+ * place before the next request is written. The whole chain, and everything queued by uring_sendto, is submitted in a
+ * single system call. A reply that does not arrive within @p timeout cancels the rest of the chain
+ *
+ * @param sock stream socket
+ * @param prefix bytes without reply written first, may be empty
+ * @param prefix_size size of @p prefix
+ * @param packets requests, overwritten by the replies
+ * @param packet_size size of a request and of its reply
+ * @param count number of requests, at most URING_EXCHANGE_MAX
+ * @param timeout maximum wait for each reply in milliseconds
+ * @return error code
+ * @retval 0 on success, -EBUSY if the submission queue has no room for the chain and nothing was queued, otherwise
+ * negative error code
+ */
+int uring_exchange(int sock, const void *prefix, size_t prefix_size, void *packets, size_t packet_size, size_t count,
+                   int timeout);
+
+/**
+ * @brief Queues a datagram. It is sent by the next uring_submit or uring_exchange
+ *
+ * @param sock datagram socket
+ * @param buffer datagram, copied
+ * @param size size of @p buffer
+ * @param address destination
+ * @return number of bytes queued or error code
+ * @retval @p size on success, otherwise negative error code
+ */
+ssize_t uring_sendto(int sock, const void *buffer, size_t size, const struct sockaddr_in *address);
+
+/**
+ * @brief Submits everything queued without waiting for it to complete
+ */
+void uring_submit(void);
+
+#endif
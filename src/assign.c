@@ -0,0 +1,257 @@
+#include <assign.h>
+#include <orders.h>
+#include <stdint.h>
+#include <string.h>
+#include <travel.h>
+
+#define ASSIGN_HANDOVER_PENALTY_MS (3000)
+#define ASSIGN_CALLS (2 * FLOOR_COUNT)
+/* The matching takes O(cars * calls^3) on the control loop, so only the calls that can be served soonest are matched and
+ * the others are queued on their cheapest car */
+#define ASSIGN_MATCHED_CALLS (ASSIGN_CALLS < 8 ? ASSIGN_CALLS : 8)
+#define ASSIGN_COLUMNS (ELEVATOR_COUNT * ASSIGN_MATCHED_CALLS)
+#define ASSIGN_INFINITY (INT64_MAX / 4)
+
+typedef struct
+{
+    uint8_t direction;
+    uint8_t floor;
+} call_t;
+
+static call_t calls[ASSIGN_CALLS];
+static int64_t costs[ASSIGN_CALLS][ELEVATOR_COUNT]; // Estimated service time of every call by every usable car
+static uint8_t cars[ELEVATOR_COUNT];
+static uint16_t door_times[ELEVATOR_COUNT];
+
+/* Hungarian algorithm state, 1-indexed with column 0 as the free root */
+static int64_t row_potentials[ASSIGN_MATCHED_CALLS + 1];
+static int64_t column_potentials[ASSIGN_COLUMNS + 1];
+static int64_t slack[ASSIGN_COLUMNS + 1];
+static size_t matched_row[ASSIGN_COLUMNS + 1];
+static size_t previous_column[ASSIGN_COLUMNS + 1];
+static bool visited[ASSIGN_COLUMNS + 1];
+
+static bool is_usable(const elevator_t *elevators, const bool *connected, const size_t index, const size_t i)
+{
+    return connected[i] && !elevators[i].disabled && zone_of(i) == zone_of(index);
+}
+
+/**
+ * @brief Cost of column @p column for call @p row. Every car has one column per call, and its k-th call waits for the
+ * k - 1 door cycles before it
+ */
+static int64_t column_cost(const size_t row, const size_t column, const size_t call_count)
+{
+    const size_t car = (column - 1) / call_count;
+    const size_t queued = (column - 1) % call_count;
+    return costs[row - 1][car] + (int64_t)queued * door_times[car];
+}
+
+/**
+ * @brief Solves the rectangular assignment problem of @p call_count rows to @p column_count columns with the Hungarian
+ * algorithm. The result is in matched_row
+ */
+static void match(const size_t call_count, const size_t column_count)
+{
+    for (size_t j = 0; j <= column_count; ++j)
+    {
+        column_potentials[j] = 0;
+        matched_row[j] = 0;
+    }
+    for (size_t i = 0; i <= call_count; ++i)
+    {
+        row_potentials[i] = 0;
+    }
+
+    for (size_t i = 1; i <= call_count; ++i)
+    {
+        matched_row[0] = i;
+        size_t column = 0;
+        for (size_t j = 0; j <= column_count; ++j)
+        {
+            slack[j] = ASSIGN_INFINITY;
+            visited[j] = false;
+        }
+        /* Grow the alternating tree until it reaches a free column */
+        do
+        {
+            visited[column] = true;
+            const size_t row = matched_row[column];
+            int64_t delta = ASSIGN_INFINITY;
+            size_t next = 0;
+            for (size_t j = 1; j <= column_count; ++j)
+            {
+                if (visited[j])
+                {
+                    continue;
+                }
+                const int64_t reduced = column_cost(row, j, call_count) - row_potentials[row] - column_potentials[j];
+                if (reduced < slack[j])
+                {
+                    slack[j] = reduced;
+                    previous_column[j] = column;
+                }
+                if (slack[j] < delta)
+                {
+                    delta = slack[j];
+                    next = j;
+                }
+            }
+            for (size_t j = 0; j <= column_count; ++j)
+            {
+                if (visited[j])
+                {
+                    row_potentials[matched_row[j]] += delta;
+                    column_potentials[j] -= delta;
+                }
+                else
+                {
+                    slack[j] -= delta;
+                }
+            }
+            column = next;
+        } while (matched_row[column] != 0);
+
+        /* Flip the augmenting path */
+        do
+        {
+            const size_t previous = previous_column[column];
+            matched_row[column] = matched_row[previous];
+            column = previous;
+        } while (column != 0);
+    }
+}
+
+/**
+ * @brief Moves the @p matched_count calls with the lowest service time by any of the @p car_count cars to the front of
+ * calls and costs, keeping the order of equal ones, so every elevator picks the same calls from the same states
+ */
+static void select_calls(const size_t call_count, const size_t car_count, const size_t matched_count)
+{
+    int64_t soonest[ASSIGN_CALLS];
+    for (size_t i = 0; i < call_count; ++i)
+    {
+        soonest[i] = ASSIGN_INFINITY;
+        for (size_t j = 0; j < car_count; ++j)
+        {
+            soonest[i] = costs[i][j] < soonest[i] ? costs[i][j] : soonest[i];
+        }
+    }
+    for (size_t i = 0; i < matched_count; ++i)
+    {
+        size_t best = i;
+        for (size_t k = i + 1; k < call_count; ++k)
+        {
+            best = soonest[k] < soonest[best] ? k : best;
+        }
+        /* Shifting instead of swapping keeps the calls that are left in floor order */
+        const call_t call = calls[best];
+        int64_t row[ELEVATOR_COUNT];
+        memcpy(row, costs[best], sizeof(row));
+        const int64_t time = soonest[best];
+        for (size_t k = best; k > i; --k)
+        {
+            calls[k] = calls[k - 1];
+            memcpy(costs[k], costs[k - 1], sizeof(costs[k]));
+            soonest[k] = soonest[k - 1];
+        }
+        calls[i] = call;
+        memcpy(costs[i], row, sizeof(row));
+        soonest[i] = time;
+    }
+}
+
+void assign_calls(const elevator_t *elevators, const bool *connected, const size_t index,
+                  uint8_t assignment[2][FLOOR_COUNT])
+{
+    const elevator_t *elevator = &elevators[index];
+    size_t car_count = 0;
+    for (size_t i = 0; i < ELEVATOR_COUNT; ++i)
+    {
+        if (is_usable(elevators, connected, index, i))
+        {
+            door_times[car_count] = elevators[i].door_time_ms;
+            cars[car_count++] = i;
+        }
+    }
+
+    size_t call_count = 0;
+    for (uint8_t floor = 0; floor < FLOOR_COUNT; ++floor)
+    {
+        for (elevator_direction_t direction = ELEVATOR_DIRECTION_UP; direction <= ELEVATOR_DIRECTION_DOWN; ++direction)
+        {
+            assignment[direction][floor] = ASSIGN_NONE;
+            if ((elevator->floor_states[floor] & direction_to_floor_flag_button(direction)) == 0)
+            {
+                continue;
+            }
+
+            /* A car heading for the call or serving it keeps it */
+            uint8_t holder = ASSIGN_NONE;
+            if (elevator->floor_states[floor] & direction_to_floor_flag_locked(direction))
+            {
+                holder = elevator->locking_elevator[direction][floor];
+            }
+            if (holder < ELEVATOR_COUNT && is_usable(elevators, connected, index, holder) &&
+                (elevators[holder].target_floor == floor ||
+                 (elevators[holder].state == ELEVATOR_STATE_OPEN && elevators[holder].current_floor == floor)))
+            {
+                assignment[direction][floor] = holder;
+                continue;
+            }
+            if (car_count == 0)
+            {
+                continue;
+            }
+
+            calls[call_count] = (call_t){.direction = direction, .floor = floor};
+            for (size_t j = 0; j < car_count; ++j)
+            {
+                costs[call_count][j] = travel_estimate(&elevators[cars[j]], floor, direction);
+                if (holder < ELEVATOR_COUNT && holder != cars[j])
+                {
+                    costs[call_count][j] += ASSIGN_HANDOVER_PENALTY_MS;
+                }
+            }
+            ++call_count;
+        }
+    }
+    if (call_count == 0)
+    {
+        return;
+    }
+
+    const size_t matched_count = call_count < ASSIGN_MATCHED_CALLS ? call_count : ASSIGN_MATCHED_CALLS;
+    if (matched_count < call_count)
+    {
+        select_calls(call_count, car_count, matched_count);
+    }
+    match(matched_count, car_count * matched_count);
+    size_t queued[ELEVATOR_COUNT] = {0};
+    for (size_t j = 1; j <= car_count * matched_count; ++j)
+    {
+        if (matched_row[j] != 0)
+        {
+            const call_t *call = &calls[matched_row[j] - 1];
+            const size_t car = (j - 1) / matched_count;
+            assignment[call->direction][call->floor] = cars[car];
+            ++queued[car];
+        }
+    }
+
+    /* The rest go one by one behind the calls each car already has */
+    for (size_t i = matched_count; i < call_count; ++i)
+    {
+        size_t best = 0;
+        for (size_t j = 1; j < car_count; ++j)
+        {
+            if (costs[i][j] + (int64_t)queued[j] * door_times[j] <
+                costs[i][best] + (int64_t)queued[best] * door_times[best])
+            {
+                best = j;
+            }
+        }
+        assignment[calls[i].direction][calls[i].floor] = cars[best];
+        ++queued[best];
+    }
+}
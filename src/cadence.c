@@ -0,0 +1,44 @@
+#include <cadence.h>
+#include <orders.h>
+
+#define CADENCE_NEVER (-1)
+
+/* Poll periods in nanoseconds by elevator state and signal. The floor sensor of a moving car is polled every
+ * iteration, so a stop is only late by one round trip to the hardware server */
+static const int64_t periods[ELEVATOR_STATE_OPEN + 1][CADENCE_SIGNAL_COUNT] = {
+    [ELEVATOR_STATE_IDLE] = {50000000LL, 200000000LL, CADENCE_NEVER},
+    [ELEVATOR_STATE_MOVING] = {20000000LL, 0, CADENCE_NEVER},
+    [ELEVATOR_STATE_OPEN] = {20000000LL, 200000000LL, 20000000LL},
+};
+
+static int64_t period(cadence_signal_t signal, uint8_t state)
+{
+    return state <= ELEVATOR_STATE_OPEN ? periods[state][signal] : 0;
+}
+
+bool cadence_is_due(const cadence_t *cadence, cadence_signal_t signal, uint8_t state, int64_t now)
+{
+    const int64_t interval = period(signal, state);
+    return interval != CADENCE_NEVER && (cadence->polled[signal] == 0 || now - cadence->polled[signal] >= interval);
+}
+
+void cadence_polled(cadence_t *cadence, cadence_signal_t signal, int64_t now)
+{
+    cadence->polled[signal] = now;
+}
+
+int64_t cadence_next(const cadence_t *cadence, uint8_t state)
+{
+    int64_t next = INT64_MAX;
+    for (cadence_signal_t signal = 0; signal < CADENCE_SIGNAL_COUNT; ++signal)
+    {
+        const int64_t interval = period(signal, state);
+        if (interval == CADENCE_NEVER)
+        {
+            continue;
+        }
+        const int64_t due = cadence->polled[signal] + interval;
+        next = due < next ? due : next;
+    }
+    return next;
+}
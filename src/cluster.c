@@ -0,0 +1,141 @@
+#include <cluster.h>
+#include <string.h>
+
+static void update_holder(cluster_view_t *view, elevator_direction_t direction, const size_t floor)
+{
+    const uint8_t locked = direction_to_floor_flag_locked(direction);
+    uint8_t holder = CLUSTER_VIEW_NO_HOLDER;
+
+    if (view->locked_count[direction][floor] == view->connected_count)
+    {
+        for (size_t i = 0; i < ELEVATOR_COUNT; ++i)
+        {
+            if (!view->connected[i] || (view->floor_states[i][floor] & locked) == 0)
+            {
+                continue;
+            }
+            if (holder == CLUSTER_VIEW_NO_HOLDER)
+            {
+                holder = view->locking_elevator[i][direction][floor];
+            }
+            else if (holder != view->locking_elevator[i][direction][floor])
+            {
+                holder = CLUSTER_VIEW_NO_HOLDER;
+                break;
+            }
+        }
+    }
+    view->holder[direction][floor] = holder;
+}
+
+static void count_floor(cluster_view_t *view, const size_t i, const size_t floor, const int sign)
+{
+    for (elevator_direction_t direction = ELEVATOR_DIRECTION_UP; direction <= ELEVATOR_DIRECTION_DOWN; ++direction)
+    {
+        if (view->floor_states[i][floor] & direction_to_floor_flag_button(direction))
+        {
+            view->button_count[direction][floor] += sign;
+        }
+        if (view->floor_states[i][floor] & direction_to_floor_flag_locked(direction))
+        {
+            view->locked_count[direction][floor] += sign;
+        }
+    }
+}
+
+void cluster_view_init(cluster_view_t *view, const size_t index)
+{
+    memset(view, 0, sizeof(*view));
+    memset(view->holder, CLUSTER_VIEW_NO_HOLDER, sizeof(view->holder));
+    view->index = index;
+}
+
+void cluster_view_update_connections(cluster_view_t *view, const elevator_t *elevators, const bool *connected)
+{
+    bool changed = false;
+    for (size_t i = 0; i < ELEVATOR_COUNT; ++i)
+    {
+        if (connected[i] == view->connected[i])
+        {
+            continue;
+        }
+        changed = true;
+        if (connected[i])
+        {
+            /* Count the newest state of the elevator */
+            memcpy(view->floor_states[i], elevators[i].floor_states, sizeof(view->floor_states[i]));
+            memcpy(view->locking_elevator[i], elevators[i].locking_elevator, sizeof(view->locking_elevator[i]));
+        }
+        for (size_t j = 0; j < FLOOR_COUNT; ++j)
+        {
+            count_floor(view, i, j, connected[i] ? 1 : -1);
+        }
+        view->connected[i] = connected[i];
+        view->connected_count += connected[i] ? 1 : -1;
+    }
+
+    /* Every agreement depends on the set of connected elevators */
+    for (size_t j = 0; changed && j < FLOOR_COUNT; ++j)
+    {
+        update_holder(view, ELEVATOR_DIRECTION_UP, j);
+        update_holder(view, ELEVATOR_DIRECTION_DOWN, j);
+    }
+}
+
+void cluster_view_sync(cluster_view_t *view, const elevator_t *elevators, const size_t i)
+{
+    if (!view->connected[i])
+    {
+        return;
+    }
+    for (size_t j = 0; j < FLOOR_COUNT; ++j)
+    {
+        if (view->floor_states[i][j] == elevators[i].floor_states[j] &&
+            view->locking_elevator[i][ELEVATOR_DIRECTION_UP][j] ==
+                elevators[i].locking_elevator[ELEVATOR_DIRECTION_UP][j] &&
+            view->locking_elevator[i][ELEVATOR_DIRECTION_DOWN][j] ==
+                elevators[i].locking_elevator[ELEVATOR_DIRECTION_DOWN][j])
+        {
+            continue;
+        }
+        count_floor(view, i, j, -1);
+        view->floor_states[i][j] = elevators[i].floor_states[j];
+        view->locking_elevator[i][ELEVATOR_DIRECTION_UP][j] = elevators[i].locking_elevator[ELEVATOR_DIRECTION_UP][j];
+        view->locking_elevator[i][ELEVATOR_DIRECTION_DOWN][j] =
+            elevators[i].locking_elevator[ELEVATOR_DIRECTION_DOWN][j];
+        count_floor(view, i, j, 1);
+        update_holder(view, ELEVATOR_DIRECTION_UP, j);
+        update_holder(view, ELEVATOR_DIRECTION_DOWN, j);
+    }
+}
+
+uint8_t cluster_view_calls(const cluster_view_t *view, const uint8_t floor)
+{
+    uint8_t calls = 0;
+    if (view->button_count[ELEVATOR_DIRECTION_UP][floor] == view->connected_count)
+    {
+        calls |= FLOOR_FLAG_BUTTON_UP;
+    }
+    if (view->button_count[ELEVATOR_DIRECTION_DOWN][floor] == view->connected_count)
+    {
+        calls |= FLOOR_FLAG_BUTTON_DOWN;
+    }
+    return calls;
+}
+
+bool cluster_view_order_is_available(const cluster_view_t *view, elevator_direction_t direction, const uint8_t floor)
+{
+    /* Every connected elevator has the call registered, and none has locked it */
+    return view->button_count[direction][floor] == view->connected_count && view->locked_count[direction][floor] == 0;
+}
+
+bool cluster_view_floor_is_locked(const cluster_view_t *view, const elevator_t *elevator)
+{
+    /* Check if the elevator is actively handling a request at this floor */
+    if ((elevator->floor_states[elevator->current_floor] & FLOOR_FLAG_BUTTON_CAB) == 0 &&
+        elevator->current_floor != elevator->target_floor)
+    {
+        return view->holder[elevator->direction][elevator->current_floor] == view->index;
+    }
+    return true;
+}
@@ -0,0 +1,95 @@
+#include <detector.h>
+#include <math.h>
+#include <orders.h>
+#include <string.h>
+#include <time.h>
+#include <trace.h>
+
+#define DETECTOR_MIN_SAMPLES (4)
+#define DETECTOR_MIN_STD_DEV_SEC (0.1)
+#define DETECTOR_BOOTSTRAP_TIMEOUT_SEC (6.0) // Fixed timeout used until enough heartbeats have been seen
+
+static double monotonic_sec(void)
+{
+    struct timespec time;
+    trace_clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+static double phi_at(const detector_peer_t *peer, const double now)
+{
+    const double elapsed = now - peer->last_arrival;
+    if (peer->count < DETECTOR_MIN_SAMPLES)
+    {
+        return elapsed > DETECTOR_BOOTSTRAP_TIMEOUT_SEC ? INFINITY : 0.0;
+    }
+
+    const double mean = peer->sum / peer->count;
+    double std_dev = sqrt(fmax(peer->sum_squares / peer->count - mean * mean, 0.0));
+    /* Heartbeats from a busy loop are very regular, a floor on the deviation keeps a single late datagram from
+     * looking like a crash */
+    std_dev = fmax(std_dev, DETECTOR_MIN_STD_DEV_SEC);
+
+    /* Probability of a heartbeat arriving later than elapsed given normally distributed intervals */
+    const double p_later = 0.5 * erfc((elapsed - mean) / (std_dev * M_SQRT2));
+    if (p_later <= 0.0)
+    {
+        return INFINITY;
+    }
+    return -log10(p_later);
+}
+
+void detector_init(failure_detector_t *detector)
+{
+    memset(detector, 0, sizeof(*detector));
+    const double now = monotonic_sec();
+    for (size_t i = 0; i < ELEVATOR_COUNT; ++i)
+    {
+        detector->peers[i].last_arrival = now;
+    }
+}
+
+void detector_heartbeat(failure_detector_t *detector, const size_t i)
+{
+    detector_peer_t *peer = &detector->peers[i];
+    const double now = monotonic_sec();
+    const double interval = now - peer->last_arrival;
+    peer->last_arrival = now;
+
+    /* The silence before the first heartbeat is not an interval */
+    if (!peer->heard)
+    {
+        peer->heard = true;
+        return;
+    }
+
+    if (peer->count == DETECTOR_WINDOW)
+    {
+        peer->sum -= peer->intervals[peer->next];
+        peer->sum_squares -= peer->intervals[peer->next] * peer->intervals[peer->next];
+    }
+    else
+    {
+        ++peer->count;
+    }
+    peer->intervals[peer->next] = interval;
+    peer->sum += interval;
+    peer->sum_squares += interval * interval;
+    peer->next = (peer->next + 1) % DETECTOR_WINDOW;
+}
+
+double detector_phi(const failure_detector_t *detector, const size_t i)
+{
+    return phi_at(&detector->peers[i], monotonic_sec());
+}
+
+void detector_connections(const failure_detector_t *detector, bool *connected, const size_t index)
+{
+    const double now = monotonic_sec();
+    for (size_t i = 0; i < ELEVATOR_COUNT; ++i)
+    {
+        /* Only elevators in the same zone exchange full state, elevators in other zones are only seen through the
+         * zone digests */
+        connected[i] = i == index || (zone_of(i) == zone_of(index) && phi_at(&detector->peers[i], now) < PHI_THRESHOLD);
+    }
+}
@@ -1,11 +1,18 @@
 #include <driver.h>
 #include <elevator.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <inttypes.h>
+#include <log.h>
+#include <netinet/tcp.h>
+#include <poll.h>
 #include <stdbool.h>
 #include <string.h>
 #include <sys/time.h>
+#include <time.h>
+#include <trace.h>
 #include <unistd.h>
+#include <uring.h>
 
 typedef struct
 {
@@ -27,114 +34,548 @@ typedef enum
     COMMAND_TYPE_OBSTRUCTION_SWITCH,
 } command_type_t;
 
-int driver_reload_config(socket_t sock)
+#define DRIVER_PENDING_PACKETS (64)
+#define DRIVER_CONNECT_TIMEOUT_MS (200) // A connection attempt that has not completed by then is given up
+#define DRIVER_BACKOFF_MIN_MS (10)      // Delay before the second attempt, doubled after every failed one
+#define DRIVER_BACKOFF_MAX_MS (100)     // Bounds the time from the server coming back to the next attempt
+
+/* With the io_uring backend, commands are held back and written together with the next request of the socket */
+typedef struct
+{
+    bool used;
+    socket_t sock;
+    size_t count;
+    packet_t packets[DRIVER_PENDING_PACKETS];
+} pending_commands_t;
+
+static pending_commands_t pending[ELEVATOR_COUNT];
+
+typedef enum
+{
+    LINK_STATE_DOWN = 0,
+    LINK_STATE_CONNECTING,
+    LINK_STATE_UP,
+} link_state_t;
+
+/* Connection to a hardware server. A new connection is moved onto the socket number of the old one, so the socket number
+ * the control loop holds stays valid across reconnections. The standby only holds the connection it was handed, which
+ * a reconnection shuts down */
+typedef struct
+{
+    bool used;
+    socket_t sock;
+    struct sockaddr_in address;
+    link_state_t state;
+    int64_t deadline; // CLOCK_MONOTONIC time in nanoseconds the attempt in progress fails or the next one starts
+    int64_t backoff;  // Delay before the next attempt in nanoseconds
+} link_t;
+
+static link_t links[ELEVATOR_COUNT];
+
+static pending_commands_t *pending_commands(socket_t sock)
+{
+    pending_commands_t *unused = NULL;
+    for (size_t i = 0; i < ELEVATOR_COUNT; ++i)
+    {
+        if (pending[i].used && pending[i].sock == sock)
+        {
+            return &pending[i];
+        }
+        if (!pending[i].used && unused == NULL)
+        {
+            unused = &pending[i];
+        }
+    }
+    if (unused != NULL)
+    {
+        unused->used = true;
+        unused->sock = sock;
+    }
+    return unused;
+}
+
+static int64_t monotonic_nsec(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (int64_t)time.tv_sec * 1000000000LL + time.tv_nsec;
+}
+
+static link_t *find_link(socket_t sock)
+{
+    for (size_t i = 0; i < ELEVATOR_COUNT; ++i)
+    {
+        if (links[i].used && links[i].sock == sock)
+        {
+            return &links[i];
+        }
+    }
+    return NULL;
+}
+
+static link_t *add_link(socket_t sock, const struct sockaddr_in *address, link_state_t state)
+{
+    link_t *link = find_link(sock);
+    for (size_t i = 0; link == NULL && i < ELEVATOR_COUNT; ++i)
+    {
+        if (!links[i].used)
+        {
+            link = &links[i];
+        }
+    }
+    if (link != NULL)
+    {
+        *link = (link_t){.used = true, .sock = sock, .state = state};
+        if (address != NULL)
+        {
+            link->address = *address;
+        }
+    }
+    return link;
+}
+
+static bool link_is_up(socket_t sock)
+{
+    const link_t *link = find_link(sock);
+    return link == NULL || link->state == LINK_STATE_UP;
+}
+
+/**
+ * @brief Gives up the connection of @p link. The next attempt starts after the backoff, which grows with every
+ * attempt that fails in a row
+ *
+ * @param link hardware connection
+ * @param err error code the connection failed with
+ */
+static void fail_link(link_t *link, int err)
+{
+    if (link->state == LINK_STATE_UP)
+    {
+        LOG_WARNING("Connection to hardware server %u lost, err = %d\n", ntohs(link->address.sin_port), -err);
+    }
+    link->state = LINK_STATE_DOWN;
+    link->deadline = monotonic_nsec() + link->backoff;
+    link->backoff = link->backoff == 0 ? DRIVER_BACKOFF_MIN_MS * 1000000LL : 2 * link->backoff;
+    if (link->backoff > DRIVER_BACKOFF_MAX_MS * 1000000LL)
+    {
+        link->backoff = DRIVER_BACKOFF_MAX_MS * 1000000LL;
+    }
+
+    pending_commands_t *commands = uring_is_enabled() ? pending_commands(link->sock) : NULL;
+    if (commands != NULL)
+    {
+        commands->count = 0;
+    }
+}
+
+/**
+ * @brief Marks the connection of @p sock as lost after a failed request. Replies of the lost connection may still
+ * arrive out of order, so it is never used again
+ *
+ * @param sock elevator socket
+ * @param err error code of the request
+ */
+static void request_failed(socket_t sock, int err)
 {
-    if (send(sock, &(packet_t){.command = COMMAND_TYPE_RELOAD_CONFIG}, sizeof(packet_t), MSG_NOSIGNAL) == -1)
+    link_t *link = find_link(sock);
+    if (link != NULL && link->state == LINK_STATE_UP)
+    {
+        link->backoff = 0; // The first attempt after a blip is immediate
+        fail_link(link, err);
+    }
+}
+
+/**
+ * @brief Starts a non-blocking connection attempt and moves it onto the socket of @p link
+ *
+ * @param link hardware connection
+ * @return error code
+ * @retval 0 on success, otherwise negative error code
+ */
+static int start_connect(link_t *link)
+{
+    socket_t sock = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, IPPROTO_TCP);
+    if (sock == -1)
     {
         return -errno;
     }
+    /* Commands are small and unanswered, so a request written right after them must not wait for their
+     * acknowledgement */
+    int value = 1;
+    if (setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &value, sizeof(value)) == -1 ||
+        (connect(sock, (struct sockaddr *)&link->address, sizeof(link->address)) == -1 && errno != EINPROGRESS))
+    {
+        int err = -errno;
+        (void)close(sock);
+        return err;
+    }
+    if (link->sock == -1)
+    {
+        link->sock = sock;
+    }
+    else if (sock != link->sock)
+    {
+        /* The standby holds the lost connection too, so closing our descriptor would not end it */
+        (void)shutdown(link->sock, SHUT_RDWR);
+        if (dup2(sock, link->sock) == -1)
+        {
+            int err = -errno;
+            (void)close(sock);
+            return err;
+        }
+        (void)close(sock);
+    }
+    link->state = LINK_STATE_CONNECTING;
+    link->deadline = monotonic_nsec() + DRIVER_CONNECT_TIMEOUT_MS * 1000000LL;
     return 0;
 }
 
-int driver_set_motor_direction(socket_t sock, motor_direction_t direction)
+/**
+ * @brief Completes the connection attempt of @p link if the server has answered it. Requests block again once the
+ * connection is up, but never for longer than DRIVER_TIMEOUT_MS
+ *
+ * @param link hardware connection
+ * @return error code
+ * @retval 1 if the connection is up, 0 if it is still in progress, otherwise negative error code
+ */
+static int complete_connect(link_t *link)
 {
-    if (send(sock, &(packet_t){.command = COMMAND_TYPE_MOTOR_DIRECTION, .args = {direction}}, sizeof(packet_t),
-             MSG_NOSIGNAL) == -1)
+    struct pollfd fd = {.fd = link->sock, .events = POLLOUT};
+    int ready = poll(&fd, 1, 0);
+    if (ready == -1)
     {
         return -errno;
     }
-    return 0;
+    if (ready == 0)
+    {
+        return monotonic_nsec() < link->deadline ? 0 : -ETIMEDOUT;
+    }
+    int err = 0;
+    socklen_t size = sizeof(err);
+    if (getsockopt(link->sock, SOL_SOCKET, SO_ERROR, &err, &size) == -1)
+    {
+        return -errno;
+    }
+    if (err != 0)
+    {
+        return -err;
+    }
+    const struct timeval timeout = {.tv_sec = 0, .tv_usec = DRIVER_TIMEOUT_MS * 1000};
+    int flags = fcntl(link->sock, F_GETFL);
+    if (flags == -1 || fcntl(link->sock, F_SETFL, flags & ~O_NONBLOCK) == -1 ||
+        setsockopt(link->sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) == -1 ||
+        setsockopt(link->sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout)) == -1)
+    {
+        return -errno;
+    }
+    return 1;
 }
 
-int driver_set_button_lamp(socket_t sock, uint8_t floor_state, uint8_t floor)
+/**
+ * @brief Advances the connection of @p link by one step without blocking
+ *
+ * @param link hardware connection
+ * @return error code
+ * @retval 1 if the connection came up, 0 if it is up, otherwise negative error code
+ */
+static int update_link(link_t *link)
 {
-    for (uint8_t i = BUTTON_TYPE_HALL_UP; i <= BUTTON_TYPE_CAB; ++i)
+    if (link->state == LINK_STATE_UP)
+    {
+        return 0;
+    }
+    if (link->state == LINK_STATE_DOWN)
     {
-        if (send(sock,
-                 &(packet_t){.command = COMMAND_TYPE_ORDER_BUTTON_LIGHT,
-                             .args = {i, floor, (floor_state & (1 << i)) != 0}},
-                 sizeof(packet_t), MSG_NOSIGNAL) == -1)
+        if (monotonic_nsec() < link->deadline)
+        {
+            return -ENOTCONN;
+        }
+        int err = start_connect(link);
+        if (err < 0)
         {
-            return -errno;
+            fail_link(link, err);
+            return err;
         }
     }
-    return 0;
+    int result = complete_connect(link);
+    if (result < 0)
+    {
+        fail_link(link, result);
+        return result;
+    }
+    if (result == 0)
+    {
+        return -EINPROGRESS;
+    }
+    LOG_INFO("Connected to hardware server %u\n", ntohs(link->address.sin_port));
+    link->state = LINK_STATE_UP;
+    link->backoff = 0;
+    return 1;
 }
 
-int driver_set_floor_indicator(socket_t sock, uint8_t floor)
+/**
+ * @brief Writes commands that have no reply. A failed write leaves it to the next request to notice the lost connection
+ *
+ * @param sock elevator socket
+ * @param packets commands
+ * @param count number of commands
+ * @return error code
+ * @retval 0 on success, otherwise negative error code
+ */
+static int transmit(socket_t sock, const packet_t *packets, size_t count)
 {
-    if (send(sock, &(packet_t){.command = COMMAND_TYPE_FLOOR_INDICATOR, .args = {floor}}, sizeof(packet_t),
-             MSG_NOSIGNAL) == -1)
+    if (!link_is_up(sock))
+    {
+        return -ENOTCONN;
+    }
+    pending_commands_t *commands = uring_is_enabled() ? pending_commands(sock) : NULL;
+    if (commands != NULL && commands->count + count <= DRIVER_PENDING_PACKETS)
+    {
+        memcpy(&commands->packets[commands->count], packets, count * sizeof(packet_t));
+        commands->count += count;
+        return 0;
+    }
+    if (trace_send(sock, packets, count * sizeof(packet_t), MSG_NOSIGNAL) == -1)
     {
         return -errno;
     }
     return 0;
 }
 
-int driver_set_door_open_lamp(socket_t sock, uint8_t value)
+/**
+ * @brief Writes requests and reads their replies. Every request waits for the reply to the previous one, since servers
+ * that delay small writes (Nagle) would otherwise hold back all but the first reply until it is acknowledged. A failed
+ * exchange loses the connection
+ *
+ * @param sock elevator socket
+ * @param packets requests, overwritten by the replies
+ * @param count number of requests
+ * @return error code
+ * @retval 0 on success, otherwise negative error code
+ */
+static int exchange(socket_t sock, packet_t *packets, size_t count)
 {
-    if (send(sock, &(packet_t){.command = COMMAND_TYPE_DOOR_OPEN_LIGHT, .args = {value}}, sizeof(packet_t),
-             MSG_NOSIGNAL) == -1)
+    if (!link_is_up(sock))
     {
-        return -errno;
+        return -ENOTCONN;
+    }
+    pending_commands_t *commands = uring_is_enabled() ? pending_commands(sock) : NULL;
+    if (commands != NULL && commands->count + count <= DRIVER_PENDING_PACKETS)
+    {
+        int err = uring_exchange(sock, commands->packets, commands->count * sizeof(packet_t), packets,
+                                 sizeof(packet_t), count, DRIVER_TIMEOUT_MS);
+        /* Nothing was queued when the submission queue is full, the blocking calls below do the exchange instead */
+        if (err != -EBUSY)
+        {
+            commands->count = 0;
+            if (err < 0)
+            {
+                request_failed(sock, err);
+            }
+            return err;
+        }
+    }
+    if (commands != NULL && commands->count > 0)
+    {
+        int err = transmit(sock, commands->packets, commands->count);
+        commands->count = 0;
+        if (err < 0)
+        {
+            request_failed(sock, err);
+            return err;
+        }
+    }
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (trace_send(sock, &packets[i], sizeof(packet_t), MSG_NOSIGNAL) == -1)
+        {
+            /* Sends are not recorded, so the failure is recorded as the reply a replay reads in its place */
+            int err = -errno;
+            trace_record(TRACE_EVENT_DRIVER, NULL, 0, err);
+            request_failed(sock, err);
+            return err;
+        }
+        ssize_t size = trace_recv(sock, &packets[i], sizeof(packet_t), MSG_NOSIGNAL | MSG_WAITALL);
+        if (size != sizeof(packet_t))
+        {
+            int err = size == -1 ? -errno : -ECONNRESET;
+            request_failed(sock, err);
+            return err;
+        }
     }
     return 0;
 }
 
-int driver_get_button_signals(socket_t sock, uint8_t *floor_states)
+int driver_reload_config(socket_t sock)
+{
+    return transmit(sock, &(packet_t){.command = COMMAND_TYPE_RELOAD_CONFIG}, 1);
+}
+
+int driver_set_motor_direction(socket_t sock, motor_direction_t direction)
+{
+    return transmit(sock, &(packet_t){.command = COMMAND_TYPE_MOTOR_DIRECTION, .args = {direction}}, 1);
+}
+
+int driver_set_button_lamp(socket_t sock, uint8_t floor_state, uint8_t floor)
+{
+    packet_t packets[BUTTON_TYPE_CAB + 1];
+    for (uint8_t i = BUTTON_TYPE_HALL_UP; i <= BUTTON_TYPE_CAB; ++i)
+    {
+        packets[i] = (packet_t){.command = COMMAND_TYPE_ORDER_BUTTON_LIGHT,
+                                .args = {i, floor, (floor_state & (1 << i)) != 0}};
+    }
+    return transmit(sock, packets, BUTTON_TYPE_CAB + 1);
+}
+
+int driver_set_floor_indicator(socket_t sock, uint8_t floor)
+{
+    return transmit(sock, &(packet_t){.command = COMMAND_TYPE_FLOOR_INDICATOR, .args = {floor}}, 1);
+}
+
+int driver_set_door_open_lamp(socket_t sock, uint8_t value)
+{
+    return transmit(sock, &(packet_t){.command = COMMAND_TYPE_DOOR_OPEN_LIGHT, .args = {value}}, 1);
+}
+
+static void button_requests(packet_t *packets)
+{
+    for (uint8_t i = 0; i < FLOOR_COUNT; ++i)
+    {
+        for (uint8_t j = 0; j <= BUTTON_TYPE_CAB; ++j)
+        {
+            packets[i * (BUTTON_TYPE_CAB + 1) + j] = (packet_t){.command = COMMAND_TYPE_ORDER_BUTTON, .args = {j, i}};
+        }
+    }
+}
+
+static void button_replies(const packet_t *packets, uint8_t *floor_states)
 {
     for (uint8_t i = 0; i < FLOOR_COUNT; ++i)
     {
         for (uint8_t j = 0; j <= BUTTON_TYPE_CAB; ++j)
         {
-            packet_t msg = {.command = COMMAND_TYPE_ORDER_BUTTON, .args = {j, i}};
-            send(sock, &msg, sizeof(packet_t), MSG_NOSIGNAL);
-            recv(sock, &msg, sizeof(packet_t), MSG_NOSIGNAL);
-            floor_states[i] |= msg.args[0] << j;
+            floor_states[i] |= (packets[i * (BUTTON_TYPE_CAB + 1) + j].args[0] != 0) << j;
         }
     }
+}
+
+static int floor_reply(const packet_t *packet)
+{
+    if (packet->args[0])
+    {
+        return packet->args[1];
+    }
+    return -ENOFLOOR;
+}
+
+int driver_get_button_signals(socket_t sock, uint8_t *floor_states)
+{
+    packet_t packets[FLOOR_COUNT * (BUTTON_TYPE_CAB + 1)];
+    button_requests(packets);
+    int err = exchange(sock, packets, FLOOR_COUNT * (BUTTON_TYPE_CAB + 1));
+    if (err < 0)
+    {
+        return err;
+    }
+    button_replies(packets, floor_states);
     return 0;
 }
 
 int driver_get_floor_sensor_signal(socket_t sock)
 {
     packet_t msg = {.command = COMMAND_TYPE_FLOOR_SENSOR};
-    send(sock, &msg, sizeof(packet_t), MSG_NOSIGNAL);
-    recv(sock, &msg, sizeof(packet_t), MSG_NOSIGNAL);
-    if (msg.args[0])
+    int err = exchange(sock, &msg, 1);
+    if (err < 0)
     {
-        return msg.args[1];
+        return err;
     }
-    return -ENOFLOOR;
+    return floor_reply(&msg);
+}
+
+int driver_get_inputs(socket_t sock, uint8_t *floor_states)
+{
+    packet_t packets[FLOOR_COUNT * (BUTTON_TYPE_CAB + 1) + 1];
+    button_requests(packets);
+    packets[FLOOR_COUNT * (BUTTON_TYPE_CAB + 1)] = (packet_t){.command = COMMAND_TYPE_FLOOR_SENSOR};
+    int err = exchange(sock, packets, FLOOR_COUNT * (BUTTON_TYPE_CAB + 1) + 1);
+    if (err < 0)
+    {
+        return err;
+    }
+    button_replies(packets, floor_states);
+    return floor_reply(&packets[FLOOR_COUNT * (BUTTON_TYPE_CAB + 1)]);
 }
 
 int driver_get_obstruction_signal(socket_t sock)
 {
     packet_t msg = {.command = COMMAND_TYPE_OBSTRUCTION_SWITCH};
-    send(sock, &msg, sizeof(msg), MSG_NOSIGNAL);
-    recv(sock, &msg, sizeof(msg), MSG_NOSIGNAL);
+    int err = exchange(sock, &msg, 1);
+    if (err < 0)
+    {
+        return err;
+    }
     return msg.args[0];
 }
 
 socket_t driver_init(const struct sockaddr_in *address)
 {
-    socket_t sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-    if (sock == -1)
+    link_t *link = add_link(-1, address, LINK_STATE_DOWN);
+    if (link == NULL)
     {
-        return -errno;
+        return -ENOBUFS;
     }
-    if (setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &(struct timeval){.tv_sec = 0, .tv_usec = 0},
-                   sizeof(struct timeval)) == -1)
+    /* The socket number is taken before the first attempt, so an attempt that fails right away is retried on it with
+     * backoff like a lost connection */
+    link->sock = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, IPPROTO_TCP);
+    if (link->sock == -1)
     {
         int err = -errno;
-        (void)close(sock);
+        link->used = false;
         return err;
     }
-    if (connect(sock, (struct sockaddr *)address, sizeof(*address)) == -1)
+    int err = start_connect(link);
+    if (err < 0)
     {
-        int err = -errno;
-        (void)close(sock);
-        return err;
+        LOG_WARNING("Could not start connecting to hardware server %u, err = %d\n", ntohs(address->sin_port), -err);
+        fail_link(link, err);
     }
-    return sock;
-}
\ No newline at end of file
+    return link->sock;
+}
+
+int driver_resume(socket_t sock, const struct sockaddr_in *address)
+{
+    /* A connection the primary replaced was shut down, and the new one was never handed over, so it is reconnected
+     * from the address by the next driver_connect */
+    struct pollfd fd = {.fd = sock, .events = 0};
+    const bool lost = poll(&fd, 1, 0) != 0;
+    link_t *link = add_link(sock, address, lost ? LINK_STATE_DOWN : LINK_STATE_UP);
+    if (link == NULL)
+    {
+        return -ENOBUFS;
+    }
+    if (lost)
+    {
+        LOG_WARNING("Connection to hardware server %u was lost before the takeover\n", ntohs(address->sin_port));
+    }
+    return 0;
+}
+
+int driver_connect(socket_t sock)
+{
+    /* A replay has no connections. It only follows the recorded ones, so requests fail where they failed */
+    link_t *link = find_link(sock);
+    if (trace_is_replaying())
+    {
+        link = link != NULL ? link : add_link(sock, NULL, LINK_STATE_DOWN);
+        const int32_t result = trace_replay(TRACE_EVENT_LINK, NULL, 0);
+        if (link != NULL)
+        {
+            link->state = result >= 0 ? LINK_STATE_UP : LINK_STATE_DOWN;
+        }
+        return result;
+    }
+    const int result = link != NULL ? update_link(link) : -EBADF;
+    trace_record(TRACE_EVENT_LINK, NULL, 0, result);
+    return result;
+}
@@ -0,0 +1,82 @@
+#include <dwell.h>
+#include <orders.h>
+
+#define DWELL_EXIT_MS (2000)     // Dwell of stops where passengers only leave
+#define DWELL_BOARDING_MS (2000) // Boarding time assumed at floors that have not been learned yet
+#define DWELL_MIN_MS (2000)      // Bounds of the dwell of stops where passengers board
+#define DWELL_MAX_MS (5000)
+#define DWELL_HOLD_MS (1000)      // Time the door is held after the last boarding activity or obstruction
+#define DWELL_SMOOTHING_SHIFT (2) // Exponential smoothing with weight 1/4 on every new stop
+
+static bool serves_hall_call(const elevator_t *elevator, const size_t index)
+{
+    const uint8_t floor = elevator->current_floor;
+    return ((elevator->floor_states[floor] & FLOOR_FLAG_LOCKED_UP) &&
+            elevator->locking_elevator[ELEVATOR_DIRECTION_UP][floor] == index) ||
+           ((elevator->floor_states[floor] & FLOOR_FLAG_LOCKED_DOWN) &&
+            elevator->locking_elevator[ELEVATOR_DIRECTION_DOWN][floor] == index);
+}
+
+static void hold(dwell_t *dwell, int64_t now)
+{
+    const int64_t close_time = now + DWELL_HOLD_MS * 1000000LL;
+    dwell->close_time = close_time > dwell->close_time ? close_time : dwell->close_time;
+}
+
+void dwell_init(dwell_t *dwell)
+{
+    for (size_t i = 0; i < FLOOR_COUNT; ++i)
+    {
+        dwell->boarding_ms[i] = DWELL_BOARDING_MS;
+    }
+}
+
+void dwell_open(dwell_t *dwell, const elevator_t *elevator, const size_t index, int64_t now)
+{
+    dwell->open_time = now;
+    dwell->activity_time = 0;
+    dwell->floor = elevator->current_floor;
+    dwell->boarding = serves_hall_call(elevator, index);
+    dwell->obstructed = false;
+
+    int64_t time = DWELL_EXIT_MS;
+    if (dwell->boarding)
+    {
+        time = (int64_t)dwell->boarding_ms[dwell->floor] + DWELL_HOLD_MS;
+        time = time < DWELL_MIN_MS ? DWELL_MIN_MS : time > DWELL_MAX_MS ? DWELL_MAX_MS : time;
+    }
+    dwell->close_time = now + time * 1000000LL;
+}
+
+void dwell_activity(dwell_t *dwell, int64_t now)
+{
+    dwell->activity_time = now;
+    hold(dwell, now);
+}
+
+void dwell_obstruction(dwell_t *dwell, bool obstructed, int64_t now)
+{
+    /* Clearing the doorway ends the boarding, so the door closes after a short hold instead of a full dwell */
+    if (dwell->obstructed && !obstructed)
+    {
+        dwell_activity(dwell, now);
+    }
+    dwell->obstructed = obstructed;
+}
+
+int64_t dwell_deadline(const dwell_t *dwell)
+{
+    return dwell->obstructed ? INT64_MAX : dwell->close_time;
+}
+
+void dwell_close(dwell_t *dwell)
+{
+    if (!dwell->boarding)
+    {
+        return;
+    }
+    /* A stop without any activity counts as no boarding time, so floors where nobody boards get the shortest dwell */
+    const int64_t sample = dwell->activity_time != 0 ? (dwell->activity_time - dwell->open_time) / 1000000LL : 0;
+    uint32_t *estimate = &dwell->boarding_ms[dwell->floor];
+    *estimate = (uint32_t)((int64_t)*estimate + ((sample - (int64_t)*estimate) >> DWELL_SMOOTHING_SHIFT));
+}
@@ -1,618 +1,1089 @@
+#include <assign.h>
+#include <cadence.h>
+#include <cluster.h>
+#include <detector.h>
+#include <dwell.h>
 #include <elevator.h>
 #include <errno.h>
+#include <events.h>
+#include <join.h>
+#include <journal.h>
+#include <local_peer.h>
 #include <log.h>
+#include <membership.h>
 #include <netinet/ip.h>
+#include <orders.h>
+#include <peer_message.h>
 #include <process.h>
+#include <realtime.h>
+#include <receiver.h>
+#include <stats.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
 #include <time.h>
+#include <trace.h>
+#include <travel.h>
+#include <uring.h>
 
-#define ELEVATOR_DISCONNECTED_TIME_SEC (6)
-#define DOOR_OPEN_TIME_SEC (3)
+#define ELEVATOR_DISCONNECTED_TIME_SEC (6) // Zone digests are dropped after this long
 #define DISABLED_TIMEOUT (8)
+#define ASSIGN_INTERVAL_SEC (1)
+#define ASSIGN_LOCK_TIMEOUT_NSEC (3000000000LL) // An assigned call nobody locked this long is taken over
+#define STATE_INTERVAL_NSEC (10000000LL) // Unchanged states are sent this often, which also bounds the wait for work
 
-typedef enum
+static void complete_order(elevator_t *elevator, socket_t elevator_socket, const size_t index)
+{
+    elevator->disabled = 0;
+    driver_set_door_open_lamp(elevator_socket, 0);
+    elevator->floor_states[elevator->current_floor] &= ~FLOOR_FLAG_BUTTON_CAB;
+    /* If this elevator currently owns the lock on the floor in the current direction */
+    if (elevator->locking_elevator[elevator->direction][elevator->current_floor] == index)
+    {
+        elevator->locking_elevator[elevator->direction][elevator->current_floor] = 255;
+        elevator->floor_states[elevator->current_floor] &= ~direction_to_floor_flag_button(elevator->direction) &
+                                                           ~direction_to_floor_flag_locked(elevator->direction);
+    }
+    driver_set_button_lamp(elevator_socket, elevator->floor_states[elevator->current_floor], elevator->current_floor);
+}
+
+typedef struct
 {
-    FLOOR_FLAG_BUTTON_UP = 1,
-    FLOOR_FLAG_BUTTON_DOWN = 1 << 1,
-    FLOOR_FLAG_BUTTON_CAB = 1 << 2,
-    FLOOR_FLAG_LOCKED_UP = 1 << 3,
-    FLOOR_FLAG_LOCKED_DOWN = 1 << 4
-} floor_flags_t;
-
-typedef enum
+    elevator_t digests[ZONE_COUNT];
+    struct timespec digest_times[ZONE_COUNT];
+    uint8_t representatives[ZONE_COUNT];
+} zone_view_t;
+
+typedef struct
+{
+    uint32_t state_counts[ELEVATOR_COUNT]; // Peer snapshot counters already taken over
+    uint32_t digest_counts[ZONE_COUNT];
+    bool heard[ELEVATOR_COUNT]; // Elevators whose own state was received, over UDP or shared memory
+} received_t;
+
+typedef struct
 {
-    ELEVATOR_STATE_IDLE = 0,
-    ELEVATOR_STATE_MOVING = 1,
-    ELEVATOR_STATE_OPEN = 2,
-} elevator_state_t;
+    dwell_t dwell;
+    struct timespec disable_timer;
+    elevator_t previous_state;
+    struct timespec time;
+    int floor_signal_err;
+    size_t index;
+    bool connected[ELEVATOR_COUNT];
+    cluster_view_t view;
+    travel_tracker_t travel;
+    uint8_t assignment[2][FLOOR_COUNT];     // Elevator each outstanding hall call was last assigned to
+    int64_t unlocked_since[2][FLOOR_COUNT]; // Poll time an outstanding hall call was first seen unlocked, else 0
+    bool taken_over[2][FLOOR_COUNT];        // Calls this elevator locks itself until they are served
+    struct timespec assign_time;
+    cadence_t cadence;
+    int64_t poll_time; // CLOCK_MONOTONIC time of the latest poll in nanoseconds
+    bool obstructed;
+    bool link_up; // Whether the hardware server is connected in this iteration
+    bool started; // Whether the hardware was set up after the first connection
+    bool homing;  // Whether the car is moving up to the first floor after starting between floors
+} controller_t;
 
-typedef enum
+typedef struct
 {
-    ELEVATOR_DIRECTION_UP = 0,
-    ELEVATOR_DIRECTION_DOWN = 1,
-} elevator_direction_t;
+    elevator_t elevators[ELEVATOR_COUNT]; // Local states as last sent to the remote peers
+    int64_t time;
+} published_t;
+
+static int64_t monotonic_nsec(void)
+{
+    struct timespec time;
+    trace_clock_gettime(CLOCK_MONOTONIC, &time);
+    return (int64_t)time.tv_sec * 1000000000LL + time.tv_nsec;
+}
 
-static floor_flags_t direction_to_floor_flag_button_(elevator_direction_t direction)
+static bool is_local(const size_t i, const size_t first, const size_t count)
 {
-    static const uint8_t table[2] = {FLOOR_FLAG_BUTTON_UP, FLOOR_FLAG_BUTTON_DOWN};
-    return table[direction];
+    return i >= first && i < first + count;
 }
 
-static floor_flags_t direction_to_floor_flag_locked_(elevator_direction_t direction)
+static bool is_in_local_zone(const size_t i, const size_t first, const size_t count)
 {
-    static const uint8_t table[2] = {FLOOR_FLAG_LOCKED_UP, FLOOR_FLAG_LOCKED_DOWN};
-    return table[direction];
+    return zone_of(i) >= zone_of(first) && zone_of(i) <= zone_of(first + count - 1);
 }
 
-static void move_to_floor(socket_t elevator_socket)
+static bool is_representative(const bool *connected, const size_t index)
 {
-    int err = driver_get_floor_sensor_signal(elevator_socket);
-    if (err < 0)
+    /* The connected elevator with the lowest index represents the zone */
+    for (size_t i = zone_of(index) * ZONE_SIZE; i < index; ++i)
     {
-        driver_set_motor_direction(elevator_socket, MOTOR_DIRECTION_UP);
-        err = driver_get_floor_sensor_signal(elevator_socket);
-        while (err < 0)
+        if (connected[i])
         {
-            err = driver_get_floor_sensor_signal(elevator_socket);
+            return false;
         }
-        driver_set_motor_direction(elevator_socket, MOTOR_DIRECTION_STOP);
     }
+    return true;
 }
 
-static void startup(elevator_t *elevator, socket_t elevator_socket)
+static bool digest_is_connected(const zone_view_t *zone_view, const size_t zone, const struct timespec *current_time)
 {
-    driver_reload_config(elevator_socket);
-    move_to_floor(elevator_socket);
-    elevator->current_floor = driver_get_floor_sensor_signal(elevator_socket);
-    driver_set_floor_indicator(elevator_socket, elevator->current_floor);
+    return zone_view->digest_times[zone].tv_sec + ELEVATOR_DISCONNECTED_TIME_SEC >= current_time->tv_sec;
+}
 
+static void send_to(const system_state_t *system, const void *message, const size_t size,
+                    const struct sockaddr_in *address)
+{
+    /* With io_uring the datagrams of an iteration are queued and sent together by uring_submit */
+    if (uring_is_enabled() && uring_sendto(system->peer_socket, message, size, address) >= 0)
+    {
+        stats_datagram_out();
+        return;
+    }
+    int err = trace_sendto(system->peer_socket, message, size, MSG_NOSIGNAL, (const struct sockaddr *)address,
+                           sizeof(*address));
+    if (err == -1)
+    {
+        LOG_ERROR("send error = %d\n", errno);
+        return;
+    }
+    stats_datagram_out();
+}
+
+static void send_gossip(const system_state_t *system)
+{
+    peer_gossip_t gossip;
+    size_t size;
+    struct sockaddr_in targets[ELEVATOR_COUNT];
+    const size_t target_count = membership_gossip(&gossip, &size, targets);
+    for (size_t i = 0; i < target_count; ++i)
+    {
+        send_to(system, &gossip, size, &targets[i]);
+    }
+}
+
+static void broadcast_states(const system_state_t *system, const size_t first, const size_t count)
+{
+    /* All elevators run by this process share one datagram, so the traffic does not grow with the number of local
+     * elevators */
+    peer_message_t message = {
+        .type = PEER_MESSAGE_TYPE_STATE, .first_index = first, .count = count, .sequence = events_state_sent()};
+    memcpy(message.elevators, &system->elevators[first], count * sizeof(elevator_t));
+
+    const uint8_t *members;
+    const size_t member_count = membership_live(&members);
+    for (size_t k = 0; k < member_count; ++k)
+    {
+        /* Peers on the same host read the state from the shared memory ring instead */
+        const size_t i = members[k];
+        if (membership_contact(i) != i || !is_in_local_zone(i, first, count) || local_peer_is_connected(i))
+        {
+            continue;
+        }
+        send_to(system, &message, offsetof(peer_message_t, elevators[count]), membership_address(i));
+    }
+}
+
+static void broadcast_digest(const system_state_t *system, zone_view_t *zone_view,
+                             const struct timespec *current_time, const size_t index, const size_t first,
+                             const size_t count)
+{
+    /* The state of the representative is merged with every elevator in its zone, so it summarizes the zone */
+    zone_digest_t digest = {.type = PEER_MESSAGE_TYPE_DIGEST, .index = index};
     for (size_t i = 0; i < FLOOR_COUNT; ++i)
     {
-        driver_set_button_lamp(elevator_socket, elevator->floor_states[i], i);
+        digest.floor_states[i] = system->elevators[index].floor_states[i] & ~FLOOR_FLAG_BUTTON_CAB;
+    }
+    memcpy(digest.locking_elevator, system->elevators[index].locking_elevator, sizeof(digest.locking_elevator));
+
+    for (size_t zone = 0; zone < ZONE_COUNT; ++zone)
+    {
+        if (zone == zone_of(index))
+        {
+            continue;
+        }
+        /* Zones represented in this process read the digest directly */
+        if (is_in_local_zone(zone * ZONE_SIZE, first, count))
+        {
+            memcpy(zone_view->digests[zone_of(index)].floor_states, digest.floor_states, sizeof(digest.floor_states));
+            memcpy(zone_view->digests[zone_of(index)].locking_elevator, digest.locking_elevator,
+                   sizeof(digest.locking_elevator));
+            zone_view->digest_times[zone_of(index)] = *current_time;
+            continue;
+        }
+        /* Send to the known representative, or to the whole zone until its representative has been heard from */
+        const size_t representative = zone_view->representatives[zone];
+        if (digest_is_connected(zone_view, zone, current_time) && membership_is_live(representative))
+        {
+            send_to(system, &digest, sizeof(digest), membership_address(representative));
+            continue;
+        }
+        const uint8_t *members;
+        const size_t member_count = membership_live(&members);
+        for (size_t k = 0; k < member_count; ++k)
+        {
+            if (zone_of(members[k]) == zone && membership_contact(members[k]) == members[k])
+            {
+                send_to(system, &digest, sizeof(digest), membership_address(members[k]));
+            }
+        }
     }
-    elevator->state = ELEVATOR_STATE_IDLE;
 }
 
-static void register_orders(elevator_t *elevators, const struct timespec *elevator_times, const size_t index)
+static void receive_states(system_state_t *system, const peer_snapshot_t *snapshot, failure_detector_t *detector,
+                           zone_view_t *zone_view, received_t *received, const size_t first, const size_t count)
 {
+    for (size_t zone = 0; zone < ZONE_COUNT; ++zone)
+    {
+        const zone_digest_t *digest = &snapshot->digests[zone];
+        if (snapshot->digest_counts[zone] == received->digest_counts[zone] ||
+            is_in_local_zone(digest->index, first, count))
+        {
+            continue;
+        }
+        received->digest_counts[zone] = snapshot->digest_counts[zone];
+        memcpy(zone_view->digests[zone].floor_states, digest->floor_states, sizeof(digest->floor_states));
+        memcpy(zone_view->digests[zone].locking_elevator, digest->locking_elevator, sizeof(digest->locking_elevator));
+        zone_view->representatives[zone] = digest->index;
+        trace_clock_gettime(CLOCK_REALTIME, &zone_view->digest_times[zone]);
+    }
     for (size_t i = 0; i < ELEVATOR_COUNT; ++i)
     {
-        /* Iterates through all elevators, excludig itself and disconnected elevators */
-        if (i == index || (elevator_times[i].tv_sec + ELEVATOR_DISCONNECTED_TIME_SEC < elevator_times[index].tv_sec))
+        if (snapshot->state_counts[i] == received->state_counts[i] || is_local(i, first, count))
         {
             continue;
         }
-        for (size_t j = 0; j < FLOOR_COUNT; ++j)
+        received->state_counts[i] = snapshot->state_counts[i];
+        received->heard[i] = true;
+        detector_heartbeat(detector, i);
+        system->elevators[i] = snapshot->elevators[i];
+    }
+    /* Peers on the same host publish their states in shared memory */
+    local_peer_discover();
+    for (size_t i = 0; i < ELEVATOR_COUNT; ++i)
+    {
+        if (!is_local(i, first, count) && is_in_local_zone(i, first, count) &&
+            local_peer_read(i, &system->elevators[i]) == 1)
         {
-            /* Check for button-up updates */
-            if (elevators[index].floor_states[j] & FLOOR_FLAG_BUTTON_UP)
-            {
-                if (elevators[index].floor_states[j] & FLOOR_FLAG_LOCKED_UP)
-                {
-                    if ((elevators[i].floor_states[j] & (FLOOR_FLAG_LOCKED_UP | FLOOR_FLAG_BUTTON_UP)) ==
-                        0) // If order was completed by a different elevator
-                    {
-                        elevators[index].floor_states[j] &=
-                            FLOOR_FLAG_BUTTON_CAB | FLOOR_FLAG_LOCKED_DOWN | FLOOR_FLAG_BUTTON_DOWN;
-                    }
+            received->heard[i] = true;
+            detector_heartbeat(detector, i);
+        }
+    }
+}
 
-                    /* If both elevators have the floor locked, they need to ensure they agree on who takes the
-                     * order */
-                    if (elevators[i].floor_states[j] & FLOOR_FLAG_LOCKED_UP)
-                    {
-                        if (elevators[i].locking_elevator[0][j] < elevators[index].locking_elevator[0][j] ||
-                            elevators[index].disabled ||
-                            elevator_times[i].tv_sec + ELEVATOR_DISCONNECTED_TIME_SEC <
-                                elevator_times[index].tv_sec) // Prioritize based on index
-                        {
-                            elevators[index].locking_elevator[0][j] = elevators[i].locking_elevator[0][j];
-                        }
-                        else
-                        {
-                            elevators[i].locking_elevator[0][j] = elevators[index].locking_elevator[0][j];
-                        }
-                    }
-                }
-                /* If our elevator is not locking, but the other elevator is locking. Locking is important to
-                 * communicate, so that we agree that the elevator can take the call */
-                else if (elevators[i].floor_states[j] & FLOOR_FLAG_LOCKED_UP)
-                {
-                    elevators[index].floor_states[j] |= FLOOR_FLAG_LOCKED_UP;
-                    elevators[index].locking_elevator[0][j] = elevators[i].locking_elevator[0][j];
-                }
+static void send_join(const system_state_t *system, const peer_snapshot_t *snapshot)
+{
+    struct sockaddr_in address;
+    peer_sync_request_t request;
+    if (join_request(&request, &address))
+    {
+        send_to(system, &request, sizeof(request), &address);
+    }
+    peer_sync_t reply;
+    while (join_next_reply(snapshot, system->elevators, &reply, &address))
+    {
+        send_to(system, &reply, sizeof(reply), &address);
+    }
+}
+
+static bool is_assigned_elsewhere(const system_state_t *system, const controller_t *controller,
+                                  const elevator_direction_t direction, const size_t floor)
+{
+    /* The assignment is only followed while the elevator it names can take the call */
+    const uint8_t assigned = controller->assignment[direction][floor];
+    return assigned != ASSIGN_NONE && assigned != controller->index && controller->connected[assigned] &&
+           !system->elevators[assigned].disabled;
+}
+
+static void update_assignments(const system_state_t *system, controller_t *controller)
+{
+    const size_t index = controller->index;
+    const elevator_t *elevator = &system->elevators[index];
+    for (size_t i = 0; i < FLOOR_COUNT; ++i)
+    {
+        for (elevator_direction_t direction = ELEVATOR_DIRECTION_UP; direction <= ELEVATOR_DIRECTION_DOWN; ++direction)
+        {
+            /* A served call drops its entry, so a new call at the floor is not held back until the next matching */
+            if ((elevator->floor_states[i] & direction_to_floor_flag_button(direction)) == 0)
+            {
+                controller->assignment[direction][i] = ASSIGN_NONE;
+                controller->unlocked_since[direction][i] = 0;
+                controller->taken_over[direction][i] = false;
+                continue;
             }
-            /* In this case our elevator is not aware of any calls, but will update its state if any other elevators
-             * have a call registered */
-            else if ((elevators[i].floor_states[j] & FLOOR_FLAG_BUTTON_UP) &&
-                     ((elevators[i].floor_states[j] & FLOOR_FLAG_LOCKED_UP) == 0))
+            if (elevator->floor_states[i] & direction_to_floor_flag_locked(direction))
             {
-                elevators[index].floor_states[j] |= FLOOR_FLAG_BUTTON_UP;
+                controller->unlocked_since[direction][i] = 0;
+                continue;
             }
-
-            /* Check for button down updates */
-            if (elevators[index].floor_states[j] & FLOOR_FLAG_BUTTON_DOWN)
+            if (controller->unlocked_since[direction][i] == 0)
             {
-                if (elevators[index].floor_states[j] & FLOOR_FLAG_LOCKED_DOWN)
-                {
-                    if ((elevators[i].floor_states[j] & (FLOOR_FLAG_LOCKED_DOWN | FLOOR_FLAG_BUTTON_DOWN)) ==
-                        0) // If order was completed by a different elevator
-                    {
-                        elevators[index].floor_states[j] &=
-                            FLOOR_FLAG_BUTTON_CAB | FLOOR_FLAG_LOCKED_UP | FLOOR_FLAG_BUTTON_UP;
-                    }
-
-                    /* If both elevators have the floor locked. They need to ensure they agree on who takes the
-                     * order */
-                    if (elevators[i].floor_states[j] & FLOOR_FLAG_LOCKED_DOWN)
-                    {
-                        if (elevators[i].locking_elevator[1][j] < elevators[index].locking_elevator[1][j] ||
-                            elevators[index].disabled) // Prioritize based on index
-                        {
-                            elevators[index].locking_elevator[1][j] = elevators[i].locking_elevator[1][j];
-                        }
-                        else
-                        {
-                            elevators[i].locking_elevator[1][j] = elevators[index].locking_elevator[1][j];
-                        }
-                    }
-                }
-                /* If our elevator is not locking, but the other elevator is locking. Locking is important to
-                 * communicate, so that we agree that the elevator can take the call */
-                else if (elevators[i].floor_states[j] & FLOOR_FLAG_LOCKED_DOWN)
-                {
-                    elevators[index].floor_states[j] |= FLOOR_FLAG_LOCKED_DOWN;
-                    elevators[index].locking_elevator[1][j] = elevators[i].locking_elevator[1][j];
-                }
+                controller->unlocked_since[direction][i] = controller->poll_time;
             }
-            /* In this case our elevator is not aware of any calls, but will update its state if any other elevators
-             * have a call registered */
-            else if ((elevators[i].floor_states[j] & FLOOR_FLAG_BUTTON_DOWN) &&
-                     ((elevators[i].floor_states[j] & FLOOR_FLAG_LOCKED_DOWN) == 0))
+            /* Views that differ can assign a call to another elevator on every node. When the assigned one does not
+             * lock it in time, every elevator may lock it, and the one that does keeps it until it is served */
+            if (controller->poll_time - controller->unlocked_since[direction][i] >= ASSIGN_LOCK_TIMEOUT_NSEC &&
+                !controller->taken_over[direction][i] && controller->assignment[direction][i] != ASSIGN_NONE &&
+                controller->assignment[direction][i] != index)
             {
-                elevators[index].floor_states[j] |= FLOOR_FLAG_BUTTON_DOWN;
+                LOG_INFO("Elevator %zu takes over the call at floor %zu from %" PRIu8 "\n", index, i,
+                         controller->assignment[direction][i]);
+                controller->taken_over[direction][i] = true;
+                controller->assignment[direction][i] = index;
             }
         }
     }
 }
 
-static bool floor_is_locked(const elevator_t *elevators, const struct timespec *elevator_times, const size_t index)
+static void reassign_calls(system_state_t *system, controller_t *controller)
 {
-    /* Check if the elevator is actively handling a request at this floor */
-    if ((elevators[index].floor_states[elevators[index].current_floor] & FLOOR_FLAG_BUTTON_CAB) == 0 &&
-        elevators[index].current_floor != elevators[index].target_floor)
+    const size_t index = controller->index;
+    elevator_t *elevator = &system->elevators[index];
+    assign_calls(system->elevators, controller->connected, index, controller->assignment);
+    for (size_t i = 0; i < FLOOR_COUNT; ++i)
     {
-        for (size_t i = 0; i < ELEVATOR_COUNT; ++i)
+        for (elevator_direction_t direction = ELEVATOR_DIRECTION_UP; direction <= ELEVATOR_DIRECTION_DOWN; ++direction)
         {
-            /* Skip disconnected elevators */
-            if ((elevator_times[i].tv_sec + ELEVATOR_DISCONNECTED_TIME_SEC < elevator_times[index].tv_sec))
-            {
-                continue;
-            }
-            /* If any elevator does not have the floor locked in either direction, return false */
-            if (((elevators[i].floor_states[elevators[index].current_floor] &
-                  direction_to_floor_flag_locked_(elevators[index].direction)) == 0) ||
-                elevators[i].locking_elevator[elevators[index].direction][elevators[index].current_floor] != index)
+            if (controller->taken_over[direction][i])
             {
-                return false;
+                controller->assignment[direction][i] = index;
             }
         }
     }
-    return true;
-}
 
-static void complete_order(elevator_t *elevator, socket_t elevator_socket, const size_t index)
-{
-    elevator->disabled = 0;
-    driver_set_door_open_lamp(elevator_socket, 0);
-    elevator->floor_states[elevator->current_floor] &= ~FLOOR_FLAG_BUTTON_CAB;
-    /* If this elevator currently owns the lock on the floor in the current direction */
-    if (elevator->locking_elevator[elevator->direction][elevator->current_floor] == index)
+    /* Give up the locks on stops on the way that another elevator serves sooner. Releasing goes through the lock
+     * agreement like any other change: the peers drop the lock once they see that its holder did, and only the
+     * assigned elevator locks the call again */
+    for (size_t i = 0; i < FLOOR_COUNT; ++i)
     {
-        elevator->locking_elevator[elevator->direction][elevator->current_floor] = 255;
-        elevator->floor_states[elevator->current_floor] &= ~direction_to_floor_flag_button_(elevator->direction) &
-                                                           ~direction_to_floor_flag_locked_(elevator->direction);
+        for (elevator_direction_t direction = ELEVATOR_DIRECTION_UP; direction <= ELEVATOR_DIRECTION_DOWN; ++direction)
+        {
+            if ((elevator->floor_states[i] & direction_to_floor_flag_locked(direction)) == 0 ||
+                elevator->locking_elevator[direction][i] != index || elevator->target_floor == i ||
+                (elevator->state == ELEVATOR_STATE_OPEN && elevator->current_floor == i) ||
+                !is_assigned_elsewhere(system, controller, direction, i))
+            {
+                continue;
+            }
+            elevator->floor_states[i] &= ~direction_to_floor_flag_locked(direction);
+            elevator->locking_elevator[direction][i] = 255;
+            LOG_INFO("Elevator %zu hands the call at floor %zu over to %" PRIu8 "\n", index, i,
+                     controller->assignment[direction][i]);
+        }
     }
-    driver_set_button_lamp(elevator_socket, elevator->floor_states[elevator->current_floor], elevator->current_floor);
+    cluster_view_sync(&controller->view, system->elevators, index);
 }
 
-static bool order_is_available(const elevator_t *elevators, const struct timespec *elevator_times,
-                               const struct timespec *current_time, elevator_direction_t direction, uint8_t floor)
+static void send_events(const system_state_t *system, const peer_snapshot_t *snapshot,
+                        const controller_t *controllers, const size_t first, const size_t count)
 {
+    /* The remote peers in the zone that any local elevator still counts on. Peers on the same host see every change
+     * in the shared memory ring right away */
+    bool recipients[ELEVATOR_COUNT] = {0};
     for (size_t i = 0; i < ELEVATOR_COUNT; ++i)
     {
-        if ((elevator_times[i].tv_sec + ELEVATOR_DISCONNECTED_TIME_SEC < current_time->tv_sec))
+        for (size_t j = 0; j < count; ++j)
         {
-            continue;
-        }
-        /* If any active elevator has a button request for this floor in the given direction, or if any has already
-         * locked it, then the order is not available */
-        if ((elevators[i].floor_states[floor] & direction_to_floor_flag_button_(direction)) == 0 ||
-            ((elevators[i].floor_states[floor] & direction_to_floor_flag_locked_(direction)) != 0))
-        {
-            return false;
+            recipients[i] |= controllers[j].connected[i];
         }
+        recipients[i] &= !is_local(i, first, count) && is_in_local_zone(i, first, count) &&
+                         !local_peer_is_connected(i) && membership_is_live(i);
     }
-    return true;
-}
+    bool connected[ELEVATOR_COUNT];
+    memcpy(connected, recipients, sizeof(connected));
 
-static bool verify_locked_floors(elevator_t *elevators, const struct timespec *elevator_times,
-                                 elevator_direction_t direction, const size_t index)
-{
-    for (size_t i = 0; i < ELEVATOR_COUNT; ++i)
+    for (size_t i = 0; i < count; ++i)
+    {
+        events_track(&system->elevators[first + i], first + i, recipients);
+    }
+    peer_event_t event;
+    while (events_next(snapshot, system->elevators, connected, &event, recipients))
     {
-        if (((elevator_times[i].tv_sec + ELEVATOR_DISCONNECTED_TIME_SEC < elevator_times[index].tv_sec)) ||
-            (elevators[i].disabled && elevators[index].target_floor != elevators[i].current_floor))
+        /* One datagram per process, which acknowledges for all of its elevators */
+        bool sent[ELEVATOR_COUNT] = {0};
+        for (size_t i = 0; i < ELEVATOR_COUNT; ++i)
         {
-            /* If a disconnected elevator was recorded as the lock holder, take over the lock */
-            if (elevators[index].locking_elevator[direction][elevators[index].target_floor] == i)
+            const size_t contact = membership_contact(i);
+            if (recipients[i] && !sent[contact])
             {
-                elevators[index].locking_elevator[direction][elevators[index].target_floor] = index;
+                sent[contact] = true;
+                send_to(system, &event, sizeof(event), membership_address(contact));
             }
-            continue;
         }
+    }
+}
 
-        /* Elevators must agree on who owns the lock for the target floor */
-        if (elevators[index].locking_elevator[direction][elevators[index].target_floor] !=
-            elevators[i].locking_elevator[direction][elevators[index].target_floor])
-        {
-            return false;
-        }
+static bool publish_is_due(const system_state_t *system, published_t *published, const size_t first,
+                           const size_t count)
+{
+    /* Changes go out in the iteration they happen, unchanged states only as heartbeats */
+    const int64_t now = monotonic_nsec();
+    if (memcmp(&published->elevators[first], &system->elevators[first], count * sizeof(elevator_t)) == 0 &&
+        now - published->time < STATE_INTERVAL_NSEC)
+    {
+        return false;
     }
+    memcpy(&published->elevators[first], &system->elevators[first], count * sizeof(elevator_t));
+    published->time = now;
     return true;
 }
 
-void elevator_run(system_state_t *system, const uint16_t *ports, const size_t index)
+static void wait_for_work(const system_state_t *system, const controller_t *controllers, const size_t count)
 {
-    struct timespec door_timer;
-    struct timespec disable_timer;
-    struct timespec elevator_times[ELEVATOR_COUNT];
-    for (size_t i = 0; i < ELEVATOR_COUNT; ++i)
+    /* Sleep until the next hardware signal is due, a peer state arrives or the next heartbeat is to be sent */
+    const int64_t now = monotonic_nsec();
+    int64_t timeout = STATE_INTERVAL_NSEC;
+    for (size_t i = 0; i < count; ++i)
     {
-        clock_gettime(CLOCK_REALTIME, &elevator_times[i]);
+        const uint8_t state = system->elevators[controllers[i].index].state;
+        int64_t next = cadence_next(&controllers[i].cadence, state) - now;
+        if (state == ELEVATOR_STATE_OPEN && dwell_deadline(&controllers[i].dwell) - now < next)
+        {
+            next = dwell_deadline(&controllers[i].dwell) - now;
+        }
+        timeout = next < timeout ? next : timeout;
+    }
+    /* How late the loop wakes up from a timeout is how late it can react to the hardware in real-time mode */
+    if (timeout > 0 && receiver_wait(timeout))
+    {
+        realtime_woke(now + timeout);
     }
+}
 
-    /* Run elevator startup */
-    startup(&system->elevators[index], system->elevator_socket);
+static void controller_poll(system_state_t *system, controller_t *controller)
+{
+    const size_t index = controller->index;
+    uint8_t floor_states[FLOOR_COUNT] = {0};
+    controller->previous_state = system->elevators[index];
 
-    while (1) // Main control loop
+    /* Poll the signals that are due in the current state. Buttons and the floor sensor share one round trip to the
+     * hardware server when both are due */
+    controller->poll_time = monotonic_nsec();
+    const uint8_t state = system->elevators[index].state;
+    const bool buttons = controller->link_up &&
+                         cadence_is_due(&controller->cadence, CADENCE_SIGNAL_BUTTONS, state, controller->poll_time);
+    const bool floor =
+        controller->link_up && cadence_is_due(&controller->cadence, CADENCE_SIGNAL_FLOOR, state, controller->poll_time);
+    if (!controller->link_up)
+    {
+        controller->floor_signal_err = -ENOTCONN; // Nothing is known about the car until it is connected again
+    }
+    struct timespec request_time;
+    struct timespec reply_time;
+    clock_gettime(CLOCK_MONOTONIC, &request_time);
+    if (buttons && floor)
+    {
+        controller->floor_signal_err = driver_get_inputs(system->elevator_sockets[index], floor_states);
+    }
+    else if (buttons)
+    {
+        (void)driver_get_button_signals(system->elevator_sockets[index], floor_states);
+    }
+    else if (floor)
+    {
+        controller->floor_signal_err = driver_get_floor_sensor_signal(system->elevator_sockets[index]);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &reply_time);
+    if (buttons || floor)
     {
-        uint8_t floor_states[FLOOR_COUNT] = {0};
-        elevator_t previous_state = system->elevators[index];
+        stats_driver_rtt(index, (reply_time.tv_sec - request_time.tv_sec) * 1000000000LL +
+                                    (reply_time.tv_nsec - request_time.tv_nsec));
+    }
+    if (buttons)
+    {
+        cadence_polled(&controller->cadence, CADENCE_SIGNAL_BUTTONS, controller->poll_time);
+    }
+    if (floor)
+    {
+        cadence_polled(&controller->cadence, CADENCE_SIGNAL_FLOOR, controller->poll_time);
+    }
+    for (size_t i = 0; i < FLOOR_COUNT; ++i)
+    {
+        system->elevators[index].floor_states[i] |= floor_states[i];
+        LOG_INFO("floor_state %zu = %u\n", i, system->elevators[index].floor_states[i]);
+    }
+    /* Update current floor from sensor */
+    if (controller->floor_signal_err >= 0)
+    {
+        system->elevators[index].current_floor = controller->floor_signal_err;
+    }
+    travel_observe(&controller->travel, &system->elevators[index], controller->floor_signal_err, index);
 
-        /* Poll locval button inputs */
-        driver_get_button_signals(system->elevator_socket, floor_states);
-        for (size_t i = 0; i < FLOOR_COUNT; ++i)
-        {
-            system->elevators[index].floor_states[i] |= floor_states[i];
-            LOG_INFO("floor_state %zu = %u\n", i, system->elevators[index].floor_states[i]);
-        }
-        /* Update current floor from sensor */
-        int floor_signal_err = driver_get_floor_sensor_signal(system->elevator_socket);
-        if (floor_signal_err >= 0)
+    LOG_INFO("index = %zu, current_floor = %" PRIu8 ",target_floor = %" PRIu8 ", current_state = %" PRIu8
+             ", elevator_direction = %" PRIu8 ", disabled = %" PRIu8 "\n",
+             index, system->elevators[index].current_floor, system->elevators[index].target_floor,
+             system->elevators[index].state, system->elevators[index].direction, system->elevators[index].disabled);
+}
+
+static void open_door(system_state_t *system, controller_t *controller)
+{
+    const size_t index = controller->index;
+    system->elevators[index].state = ELEVATOR_STATE_OPEN;
+    driver_set_door_open_lamp(system->elevator_sockets[index], 1);
+    dwell_open(&controller->dwell, &system->elevators[index], index, controller->poll_time);
+}
+
+static void controller_update(system_state_t *system, controller_t *controller, const failure_detector_t *detector,
+                              zone_view_t *zone_view)
+{
+    const size_t index = controller->index;
+    const socket_t elevator_socket = system->elevator_sockets[index];
+    const elevator_t previous_state = controller->previous_state;
+
+    /* Peers whose suspicion level crossed the threshold drop out of every decision, which also hands their locks
+     * over in verify_locked_floors */
+    bool previously_connected[ELEVATOR_COUNT];
+    memcpy(previously_connected, controller->connected, sizeof(previously_connected));
+    detector_connections(detector, controller->connected, index);
+    for (size_t i = 0; i < ELEVATOR_COUNT; ++i)
+    {
+        if (previously_connected[i] && !controller->connected[i])
         {
-            system->elevators[index].current_floor = floor_signal_err;
+            LOG_WARNING("Elevator %zu suspected by %zu, phi = %.1f\n", i, index, detector_phi(detector, i));
         }
+    }
+    cluster_view_update_connections(&controller->view, system->elevators, controller->connected);
+    register_orders(system->elevators, controller->connected, index);
 
-        /* Broadcast local elevator state to all peers */
-        for (size_t i = 0; i < ELEVATOR_COUNT; ++i)
+    /* The zone representative merges the digests of the other zones, the rest of the zone follows its state */
+    if (ZONE_COUNT > 1 && is_representative(controller->connected, index))
+    {
+        for (size_t zone = 0; zone < ZONE_COUNT; ++zone)
         {
-            if (i == index)
+            if (zone != zone_of(index) && digest_is_connected(zone_view, zone, &controller->time))
             {
-                continue;
-            }
-            struct sockaddr_in broadcast_addr = {
-                .sin_family = AF_INET, .sin_port = htons(ports[i]), .sin_addr.s_addr = INADDR_BROADCAST};
-            int err = sendto(system->peer_socket, &system->elevators[index], sizeof(*system->elevators), MSG_NOSIGNAL,
-                             (struct sockaddr *)&broadcast_addr, sizeof(broadcast_addr));
-            if (err == -1)
-            {
-                LOG_ERROR("broadcast error = %d\n", errno);
+                register_peer_orders(&system->elevators[index], index, &zone_view->digests[zone],
+                                     zone_view->representatives[zone], zone);
             }
         }
+    }
+
+    /* Merging may have changed both our state and the lock holders recorded for the peers */
+    for (size_t i = 0; i < ELEVATOR_COUNT; ++i)
+    {
+        cluster_view_sync(&controller->view, system->elevators, i);
+    }
 
-        LOG_INFO("index = %zu, current_floor = %" PRIu8 ",target_floor = %" PRIu8 ", current_state = %" PRIu8
-                 ", elevator_direction = %" PRIu8 ", disabled = %" PRIu8 "\n",
-                 index, system->elevators[index].current_floor, system->elevators[index].target_floor,
-                 system->elevators[index].state, system->elevators[index].direction, system->elevators[index].disabled);
+    /* Periodically reoptimize which elevator serves each outstanding hall call */
+    update_assignments(system, controller);
+    if (controller->time.tv_sec >= controller->assign_time.tv_sec + ASSIGN_INTERVAL_SEC)
+    {
+        controller->assign_time = controller->time;
+        reassign_calls(system, controller);
+    }
 
-        /* Receive elevator states via UDP */
-        do
+    /* If floor/state change: update */
+    if (system->elevators[index].current_floor != previous_state.current_floor)
+    {
+        driver_set_floor_indicator(elevator_socket, system->elevators[index].current_floor);
+    }
+    for (uint8_t i = 0; i < FLOOR_COUNT; ++i)
+    {
+        if (system->elevators[index].floor_states[i] != previous_state.floor_states[i])
         {
-            elevator_t elevator;
-            struct sockaddr_in addr_in;
-            socklen_t addr_size = sizeof(addr_in);
-            while (recvfrom(system->peer_socket, &elevator, sizeof(elevator), MSG_NOSIGNAL, (struct sockaddr *)&addr_in,
-                            &addr_size) != -1)
-            {
-                uint8_t found = 0;
-                for (size_t i = 0; i < ELEVATOR_COUNT; ++i)
-                {
-                    if (addr_in.sin_port == htons(ports[i]))
-                    {
-                        found = 1;
-                        clock_gettime(CLOCK_REALTIME, &elevator_times[i]);
-                        system->elevators[i] = elevator;
-                    }
-                }
-                if (!found || addr_in.sin_port == htons(ports[index]))
-                {
-                    LOG_ERROR("Wrong port from recv %d\n", errno);
-                }
-            }
-        } while (0);
+            driver_set_button_lamp(elevator_socket, system->elevators[index].floor_states[i], i);
+        }
+    }
 
-        register_orders(system->elevators, elevator_times, index);
+    /* Until the car has stopped at a floor after starting, and the fleet state is complete after joining, it takes part
+     * in the decisions but serves no calls */
+    if (!controller->started || controller->homing || !join_is_synced())
+    {
+        if (controller->homing && controller->floor_signal_err >= 0)
+        {
+            driver_set_motor_direction(elevator_socket, MOTOR_DIRECTION_STOP);
+            system->elevators[index].state = ELEVATOR_STATE_IDLE;
+            system->elevators[index].disabled = 0;
+            controller->homing = false;
+        }
+        trace_clock_gettime(CLOCK_REALTIME, &controller->time);
+        cluster_view_sync(&controller->view, system->elevators, index);
+        return;
+    }
 
-        /* If floor/state change: update */
-        if (system->elevators[index].current_floor != previous_state.current_floor)
+    /* Monitor if elevator is stuck while moving. If so set the elevator to disabled */
+    if (system->elevators[index].state == ELEVATOR_STATE_MOVING)
+    {
+        if (previous_state.current_floor != system->elevators[index].current_floor)
         {
-            driver_set_floor_indicator(system->elevator_socket, system->elevators[index].current_floor);
+            controller->disable_timer = controller->time;
+            system->elevators[index].disabled = 0;
         }
-        for (uint8_t i = 0; i < FLOOR_COUNT; ++i)
+        else if (controller->disable_timer.tv_sec + DISABLED_TIMEOUT < controller->time.tv_sec)
         {
-            if (system->elevators[index].floor_states[i] != previous_state.floor_states[i])
-            {
-                driver_set_button_lamp(system->elevator_socket, system->elevators[index].floor_states[i], i);
-            }
+            system->elevators[index].disabled = 1;
         }
+    }
 
-        /* Monitor if elevator is stuck while moving. If so set the elevator to disabled */
-        if (system->elevators[index].state == ELEVATOR_STATE_MOVING)
+    /* Stop elevator at floor if it has an order there */
+    if (system->elevators[index].state == ELEVATOR_STATE_MOVING && controller->floor_signal_err >= 0)
+    {
+        /* We only stop if all elevators agree that we are taking this call */
+        if (cluster_view_floor_is_locked(&controller->view, &system->elevators[index]))
         {
-            if (previous_state.current_floor != system->elevators[index].current_floor)
-            {
-                disable_timer = elevator_times[index];
-                system->elevators[index].disabled = 0;
-            }
-            else if (disable_timer.tv_sec + DISABLED_TIMEOUT < elevator_times[index].tv_sec)
-            {
-                system->elevators[index].disabled = 1;
-            }
+            driver_set_motor_direction(elevator_socket, MOTOR_DIRECTION_STOP);
+            open_door(system, controller);
+            controller->disable_timer = controller->time;
         }
+    }
 
-        /* Stop elevator at floor if it has an order there */
-        if (system->elevators[index].state == ELEVATOR_STATE_MOVING && floor_signal_err >= 0)
+    /* Handle door timing */
+    trace_clock_gettime(CLOCK_REALTIME, &controller->time);
+    if (system->elevators[index].state == ELEVATOR_STATE_OPEN)
+    {
+        /* If stuck too long in open state, mark as disabled */
+        if (controller->disable_timer.tv_sec + DISABLED_TIMEOUT < controller->time.tv_sec)
         {
-            /* We only stop if all elevators agree that we are taking this call */
-            if (floor_is_locked(system->elevators, elevator_times, index))
-            {
-                driver_set_motor_direction(system->elevator_socket, MOTOR_DIRECTION_STOP);
-                system->elevators[index].state = ELEVATOR_STATE_OPEN;
-                driver_set_door_open_lamp(system->elevator_socket, 1);
-                clock_gettime(CLOCK_REALTIME, &door_timer);
-                disable_timer = door_timer;
-                door_timer.tv_sec += DOOR_OPEN_TIME_SEC;
-            }
+            system->elevators[index].disabled = 1;
         }
-
-        /* Handle door timing */
-        clock_gettime(CLOCK_REALTIME, &elevator_times[index]);
-        if (system->elevators[index].state == ELEVATOR_STATE_OPEN)
+        /* Hold the door while obstructed */
+        if (cadence_is_due(&controller->cadence, CADENCE_SIGNAL_OBSTRUCTION, ELEVATOR_STATE_OPEN,
+                           controller->poll_time))
         {
-            struct timespec current_time;
-            clock_gettime(CLOCK_REALTIME, &current_time);
-            /* If stuck too long in open state, mark as disabled */
-            if (disable_timer.tv_sec + DISABLED_TIMEOUT < current_time.tv_sec)
+            /* The door stays as it was last seen while the hardware server is not connected */
+            const int obstruction = driver_get_obstruction_signal(elevator_socket);
+            controller->obstructed = obstruction >= 0 ? obstruction > 0 : controller->obstructed;
+            cadence_polled(&controller->cadence, CADENCE_SIGNAL_OBSTRUCTION, controller->poll_time);
+        }
+        dwell_obstruction(&controller->dwell, controller->obstructed, controller->poll_time);
+        /* A cab button pressed while the door is open means passengers are still boarding */
+        for (size_t i = 0; i < FLOOR_COUNT; ++i)
+        {
+            if (system->elevators[index].floor_states[i] & ~previous_state.floor_states[i] & FLOOR_FLAG_BUTTON_CAB)
             {
-                system->elevators[index].disabled = 1;
+                dwell_activity(&controller->dwell, controller->poll_time);
             }
-            /* Extend door timer if obstructed */
-            if (driver_get_obstruction_signal(system->elevator_socket))
+        }
+        /* Complete order and continue */
+        if (controller->poll_time >= dwell_deadline(&controller->dwell))
+        {
+            dwell_close(&controller->dwell);
+            complete_order(&system->elevators[index], elevator_socket, index);
+            if (system->elevators[index].target_floor == system->elevators[index].current_floor)
             {
-                door_timer = current_time;
-                door_timer.tv_sec += DOOR_OPEN_TIME_SEC;
+                system->elevators[index].state = ELEVATOR_STATE_IDLE;
             }
-            /* Complete order and continue */
-            else if (current_time.tv_sec > door_timer.tv_sec)
+            else
             {
-                complete_order(&system->elevators[index], system->elevator_socket, index);
-                if (system->elevators[index].target_floor == system->elevators[index].current_floor)
+                system->elevators[index].state = ELEVATOR_STATE_MOVING;
+                controller->disable_timer = controller->time;
+                if (system->elevators[index].target_floor > system->elevators[index].current_floor)
                 {
-                    system->elevators[index].state = ELEVATOR_STATE_IDLE;
+                    driver_set_motor_direction(elevator_socket, MOTOR_DIRECTION_UP);
                 }
                 else
                 {
-                    system->elevators[index].state = ELEVATOR_STATE_MOVING;
-                    disable_timer = elevator_times[index];
-                    if (system->elevators[index].target_floor > system->elevators[index].current_floor)
-                    {
-                        driver_set_motor_direction(system->elevator_socket, MOTOR_DIRECTION_UP);
-                    }
-                    else
-                    {
-                        driver_set_motor_direction(system->elevator_socket, MOTOR_DIRECTION_DOWN);
-                    }
+                    driver_set_motor_direction(elevator_socket, MOTOR_DIRECTION_DOWN);
                 }
             }
         }
+    }
 
-        /* Lock available orders in our direction of movement */
-        if (system->elevators[index].state != ELEVATOR_STATE_IDLE)
+    /* Completing an order changes our state */
+    cluster_view_sync(&controller->view, system->elevators, index);
+
+    /* Lock available orders in our direction of movement */
+    if (system->elevators[index].state != ELEVATOR_STATE_IDLE)
+    {
+        /* Up direction order locking */
+        if (system->elevators[index].direction == ELEVATOR_DIRECTION_UP)
         {
-            /* Up direction order locking */
-            if (system->elevators[index].direction == ELEVATOR_DIRECTION_UP)
+            for (size_t i = system->elevators[index].current_floor; i < FLOOR_COUNT; i++)
             {
-                for (size_t i = system->elevators[index].current_floor; i < FLOOR_COUNT; i++)
+                if (cluster_view_order_is_available(&controller->view, ELEVATOR_DIRECTION_UP, i) &&
+                    !is_assigned_elsewhere(system, controller, ELEVATOR_DIRECTION_UP, i))
                 {
-                    if (order_is_available(system->elevators, elevator_times, &elevator_times[index],
-                                           ELEVATOR_DIRECTION_UP, i))
-                    {
-                        system->elevators[index].floor_states[i] |= FLOOR_FLAG_LOCKED_UP;
-                        system->elevators[index].locking_elevator[0][i] = index;
-                        if (system->elevators[index].target_floor < i)
-                        {
-                            system->elevators[index].target_floor = i;
-                        }
-                    }
-                    if ((system->elevators[index].floor_states[i] & FLOOR_FLAG_BUTTON_CAB) &&
-                        system->elevators[index].target_floor < i)
+                    system->elevators[index].floor_states[i] |= FLOOR_FLAG_LOCKED_UP;
+                    system->elevators[index].locking_elevator[0][i] = index;
+                    cluster_view_sync(&controller->view, system->elevators, index);
+                    if (system->elevators[index].target_floor < i)
                     {
                         system->elevators[index].target_floor = i;
                     }
                 }
+                if ((system->elevators[index].floor_states[i] & FLOOR_FLAG_BUTTON_CAB) &&
+                    system->elevators[index].target_floor < i)
+                {
+                    system->elevators[index].target_floor = i;
+                }
             }
+        }
 
-            /* Down direction order locking */
-            if (system->elevators[index].direction == ELEVATOR_DIRECTION_DOWN)
+        /* Down direction order locking */
+        if (system->elevators[index].direction == ELEVATOR_DIRECTION_DOWN)
+        {
+            for (size_t i = system->elevators[index].current_floor; i > 0; i--)
             {
-                for (size_t i = system->elevators[index].current_floor; i > 0; i--)
+                if (cluster_view_order_is_available(&controller->view, ELEVATOR_DIRECTION_DOWN, i) &&
+                    !is_assigned_elsewhere(system, controller, ELEVATOR_DIRECTION_DOWN, i))
                 {
-                    if (order_is_available(system->elevators, elevator_times, &elevator_times[index],
-                                           ELEVATOR_DIRECTION_DOWN, i))
-                    {
-                        system->elevators[index].floor_states[i] |= FLOOR_FLAG_LOCKED_DOWN;
-                        system->elevators[index].locking_elevator[1][i] = index;
-                        if (system->elevators[index].target_floor > i)
-                        {
-                            system->elevators[index].target_floor = i;
-                        }
-                    }
-                    if ((system->elevators[index].floor_states[i] & FLOOR_FLAG_BUTTON_CAB) &&
-                        system->elevators[index].target_floor > i)
+                    system->elevators[index].floor_states[i] |= FLOOR_FLAG_LOCKED_DOWN;
+                    system->elevators[index].locking_elevator[1][i] = index;
+                    cluster_view_sync(&controller->view, system->elevators, index);
+                    if (system->elevators[index].target_floor > i)
                     {
                         system->elevators[index].target_floor = i;
                     }
                 }
+                if ((system->elevators[index].floor_states[i] & FLOOR_FLAG_BUTTON_CAB) &&
+                    system->elevators[index].target_floor > i)
+                {
+                    system->elevators[index].target_floor = i;
+                }
             }
         }
+    }
 
-        if (system->elevators[index].state != ELEVATOR_STATE_IDLE)
+    if (system->elevators[index].state != ELEVATOR_STATE_IDLE)
+    {
+        return;
+    }
+
+    /* Check for cab calls */
+    for (system->elevators[index].target_floor = 0; system->elevators[index].target_floor < FLOOR_COUNT;
+         ++system->elevators[index].target_floor)
+    {
+        if ((system->elevators[index].floor_states[system->elevators[index].target_floor] &
+             FLOOR_FLAG_BUTTON_CAB) == 0)
         {
             continue;
         }
 
-        /* Check for cab calls */
-        for (system->elevators[index].target_floor = 0; system->elevators[index].target_floor < FLOOR_COUNT;
-             ++system->elevators[index].target_floor)
+        if (system->elevators[index].target_floor > system->elevators[index].current_floor)
+        {
+            system->elevators[index].direction = ELEVATOR_DIRECTION_UP;
+            system->elevators[index].locking_elevator[0][system->elevators[index].target_floor] = index;
+            system->elevators[index].floor_states[system->elevators[index].target_floor] |= FLOOR_FLAG_LOCKED_UP;
+            system->elevators[index].state = ELEVATOR_STATE_MOVING;
+            controller->disable_timer = controller->time;
+            driver_set_motor_direction(elevator_socket, MOTOR_DIRECTION_UP);
+        }
+        if (system->elevators[index].target_floor < system->elevators[index].current_floor)
+        {
+            system->elevators[index].direction = ELEVATOR_DIRECTION_DOWN;
+            system->elevators[index].locking_elevator[1][system->elevators[index].target_floor] = index;
+            system->elevators[index].floor_states[system->elevators[index].target_floor] |= FLOOR_FLAG_LOCKED_DOWN;
+            system->elevators[index].state = ELEVATOR_STATE_MOVING;
+            controller->disable_timer = controller->time;
+            driver_set_motor_direction(elevator_socket, MOTOR_DIRECTION_DOWN);
+        }
+        if (system->elevators[index].target_floor == system->elevators[index].current_floor)
+        {
+            open_door(system, controller);
+        }
+        break;
+    }
+
+    if (system->elevators[index].state != ELEVATOR_STATE_IDLE)
+    {
+        return;
+    }
+
+    /* Check for hall calls */
+    for (system->elevators[index].target_floor = 0; system->elevators[index].target_floor < FLOOR_COUNT;
+         ++system->elevators[index].target_floor)
+    {
+        /* Check if all elevators verify and agree a valid call */
+        uint8_t do_call = cluster_view_calls(&controller->view, system->elevators[index].target_floor);
+        /* Leave calls assigned to another elevator to it, unless this elevator locked them already */
+        for (elevator_direction_t direction = ELEVATOR_DIRECTION_UP; direction <= ELEVATOR_DIRECTION_DOWN; ++direction)
         {
-            if ((system->elevators[index].floor_states[system->elevators[index].target_floor] &
-                 FLOOR_FLAG_BUTTON_CAB) == 0)
+            const uint8_t floor = system->elevators[index].target_floor;
+            if (is_assigned_elsewhere(system, controller, direction, floor) &&
+                !((system->elevators[index].floor_states[floor] & direction_to_floor_flag_locked(direction)) &&
+                  system->elevators[index].locking_elevator[direction][floor] == index))
             {
-                continue;
+                do_call &= ~direction_to_floor_flag_button(direction);
             }
-
-            if (system->elevators[index].target_floor > system->elevators[index].current_floor)
+        }
+        /* If no shared order at this floor, continue */
+        if (do_call == 0)
+        {
+            continue;
+        }
+        /* Hall UP */
+        if (do_call & FLOOR_FLAG_BUTTON_UP)
+        {
+            if (!(system->elevators[index].floor_states[system->elevators[index].target_floor] &
+                  FLOOR_FLAG_LOCKED_UP))
             {
-                system->elevators[index].direction = ELEVATOR_DIRECTION_UP;
+                system->elevators[index].floor_states[system->elevators[index].target_floor] |=
+                    FLOOR_FLAG_LOCKED_UP;
                 system->elevators[index].locking_elevator[0][system->elevators[index].target_floor] = index;
-                system->elevators[index].floor_states[system->elevators[index].target_floor] |= FLOOR_FLAG_LOCKED_UP;
-                system->elevators[index].state = ELEVATOR_STATE_MOVING;
-                disable_timer = elevator_times[index];
-                driver_set_motor_direction(system->elevator_socket, MOTOR_DIRECTION_UP);
+                break;
             }
-            if (system->elevators[index].target_floor < system->elevators[index].current_floor)
+            if (!verify_locked_floors(system->elevators, controller->connected, ELEVATOR_DIRECTION_UP, index))
             {
-                system->elevators[index].direction = ELEVATOR_DIRECTION_DOWN;
-                system->elevators[index].locking_elevator[1][system->elevators[index].target_floor] = index;
-                system->elevators[index].floor_states[system->elevators[index].target_floor] |= FLOOR_FLAG_LOCKED_DOWN;
-                system->elevators[index].state = ELEVATOR_STATE_MOVING;
-                disable_timer = elevator_times[index];
-                driver_set_motor_direction(system->elevator_socket, MOTOR_DIRECTION_DOWN);
+                continue;
             }
-            if (system->elevators[index].target_floor == system->elevators[index].current_floor)
+            if (system->elevators[index].locking_elevator[0][system->elevators[index].target_floor] != index)
             {
-                system->elevators[index].state = ELEVATOR_STATE_OPEN;
-                driver_set_door_open_lamp(system->elevator_socket, 1);
-                clock_gettime(CLOCK_REALTIME, &door_timer);
-                door_timer.tv_sec += DOOR_OPEN_TIME_SEC;
+                continue;
             }
-            break;
-        }
 
-        if (system->elevators[index].state != ELEVATOR_STATE_IDLE)
-        {
-            continue;
+            /* Valid hall UP order, start moving */
+            system->elevators[index].direction = ELEVATOR_DIRECTION_UP;
         }
-
-        /* Check for hall calls */
-        for (system->elevators[index].target_floor = 0; system->elevators[index].target_floor < FLOOR_COUNT;
-             ++system->elevators[index].target_floor)
+        /* Hall DOWN */
+        else
         {
-            uint8_t do_call = FLOOR_FLAG_BUTTON_DOWN | FLOOR_FLAG_BUTTON_UP;
-            /* Check if all elevators verify and agree a valid call */
-            for (size_t i = 0; i < ELEVATOR_COUNT; ++i)
+
+            if (!(system->elevators[index].floor_states[system->elevators[index].target_floor] &
+                  FLOOR_FLAG_LOCKED_DOWN))
             {
-                /* Ignore disconnected elevators */
-                if ((elevator_times[i].tv_sec + ELEVATOR_DISCONNECTED_TIME_SEC < elevator_times[index].tv_sec))
-                {
-                    continue;
-                }
-                do_call &= system->elevators[i].floor_states[system->elevators[index].target_floor];
+                system->elevators[index].floor_states[system->elevators[index].target_floor] |=
+                    FLOOR_FLAG_LOCKED_DOWN;
+                system->elevators[index].locking_elevator[1][system->elevators[index].target_floor] = index;
+                break;
             }
-            /* If no shared order at this floor, continue */
-            if (do_call == 0)
+            if (!verify_locked_floors(system->elevators, controller->connected, ELEVATOR_DIRECTION_DOWN, index))
             {
                 continue;
             }
-            /* Hall UP */
-            if (do_call & FLOOR_FLAG_BUTTON_UP)
+            if (system->elevators[index].locking_elevator[1][system->elevators[index].target_floor] != index)
             {
-                if (!(system->elevators[index].floor_states[system->elevators[index].target_floor] &
-                      FLOOR_FLAG_LOCKED_UP))
-                {
-                    system->elevators[index].floor_states[system->elevators[index].target_floor] |=
-                        FLOOR_FLAG_LOCKED_UP;
-                    system->elevators[index].locking_elevator[0][system->elevators[index].target_floor] = index;
-                    break;
-                }
-                if (!verify_locked_floors(system->elevators, elevator_times, ELEVATOR_DIRECTION_UP, index))
-                {
-                    continue;
-                }
-                if (system->elevators[index].locking_elevator[0][system->elevators[index].target_floor] != index)
-                {
-                    continue;
-                }
-
-                /* Valid hall UP order, start moving */
-                system->elevators[index].direction = ELEVATOR_DIRECTION_UP;
+                continue;
             }
-            /* Hall DOWN */
-            else
-            {
+            /* Valid hall DOWN order, start moving */
+            system->elevators[index].direction = ELEVATOR_DIRECTION_DOWN;
+        }
 
-                if (!(system->elevators[index].floor_states[system->elevators[index].target_floor] &
-                      FLOOR_FLAG_LOCKED_DOWN))
-                {
-                    system->elevators[index].floor_states[system->elevators[index].target_floor] |=
-                        FLOOR_FLAG_LOCKED_DOWN;
-                    system->elevators[index].locking_elevator[1][system->elevators[index].target_floor] = index;
-                    break;
-                }
-                if (!verify_locked_floors(system->elevators, elevator_times, ELEVATOR_DIRECTION_DOWN, index))
-                {
-                    continue;
-                }
-                if (system->elevators[index].locking_elevator[1][system->elevators[index].target_floor] != index)
+        /* Start moving UP or DOWN or opening doors depending on the relation between current_floor and target_floor
+         */
+        if (system->elevators[index].target_floor > system->elevators[index].current_floor)
+        {
+            system->elevators[index].state = ELEVATOR_STATE_MOVING;
+            controller->disable_timer = controller->time;
+            driver_set_motor_direction(elevator_socket, MOTOR_DIRECTION_UP);
+        }
+        if (system->elevators[index].target_floor < system->elevators[index].current_floor)
+        {
+            system->elevators[index].state = ELEVATOR_STATE_MOVING;
+            controller->disable_timer = controller->time;
+            driver_set_motor_direction(elevator_socket, MOTOR_DIRECTION_DOWN);
+        }
+        if (system->elevators[index].target_floor == system->elevators[index].current_floor)
+        {
+            open_door(system, controller);
+        }
+        break;
+    }
+}
+
+static void set_lamps(const elevator_t *elevator, socket_t elevator_socket)
+{
+    driver_set_floor_indicator(elevator_socket, elevator->current_floor);
+    for (size_t i = 0; i < FLOOR_COUNT; ++i)
+    {
+        driver_set_button_lamp(elevator_socket, elevator->floor_states[i], i);
+    }
+}
+
+static void start_controller(system_state_t *system, controller_t *controller)
+{
+    const size_t index = controller->index;
+    const socket_t elevator_socket = system->elevator_sockets[index];
+    elevator_t *elevator = &system->elevators[index];
+
+    /* A car between floors moves up to the next one, and stays disabled until it is there */
+    driver_reload_config(elevator_socket);
+    const int floor = driver_get_floor_sensor_signal(elevator_socket);
+    controller->homing = floor < 0;
+    if (controller->homing)
+    {
+        driver_set_motor_direction(elevator_socket, MOTOR_DIRECTION_UP);
+        elevator->state = ELEVATOR_STATE_MOVING;
+    }
+    else
+    {
+        elevator->current_floor = floor;
+        elevator->state = ELEVATOR_STATE_IDLE;
+        elevator->disabled = 0;
+    }
+    driver_set_door_open_lamp(elevator_socket, 0);
+    set_lamps(elevator, elevator_socket);
+    controller->started = true;
+}
+
+static void resync_controller(system_state_t *system, controller_t *controller)
+{
+    const size_t index = controller->index;
+    const socket_t elevator_socket = system->elevator_sockets[index];
+    const elevator_t *elevator = &system->elevators[index];
+
+    /* Commands written while the hardware server was not connected are lost. The control loop went on, so the motor
+     * and the lamps are set to match the state it is in now */
+    motor_direction_t direction = MOTOR_DIRECTION_STOP;
+    if (elevator->state == ELEVATOR_STATE_MOVING)
+    {
+        if (elevator->target_floor != elevator->current_floor)
+        {
+            direction = elevator->target_floor > elevator->current_floor ? MOTOR_DIRECTION_UP : MOTOR_DIRECTION_DOWN;
+        }
+        else
+        {
+            direction = elevator->direction == ELEVATOR_DIRECTION_UP ? MOTOR_DIRECTION_UP : MOTOR_DIRECTION_DOWN;
+        }
+    }
+    driver_set_motor_direction(elevator_socket, direction);
+    driver_set_door_open_lamp(elevator_socket, elevator->state == ELEVATOR_STATE_OPEN);
+    set_lamps(elevator, elevator_socket);
+    LOG_INFO("Resynchronized elevator %zu, state = %" PRIu8 ", floor = %" PRIu8 ", target = %" PRIu8 "\n", index,
+             elevator->state, elevator->current_floor, elevator->target_floor);
+}
+
+static void connect_controller(system_state_t *system, controller_t *controller)
+{
+    const int link = driver_connect(system->elevator_sockets[controller->index]);
+    controller->link_up = link >= 0;
+    if (link != 1)
+    {
+        return;
+    }
+    if (!controller->started || controller->homing)
+    {
+        start_controller(system, controller);
+    }
+    else
+    {
+        resync_controller(system, controller);
+    }
+}
+
+static void resume_controller(system_state_t *system, controller_t *controller)
+{
+    const size_t index = controller->index;
+    const socket_t elevator_socket = system->elevator_sockets[index];
+
+    /* The motor and door kept going during the handover. Only the timers of the failed primary are lost, so an open
+     * door gets a full dwell and the stuck monitor starts over */
+    trace_clock_gettime(CLOCK_REALTIME, &controller->disable_timer);
+    dwell_open(&controller->dwell, &system->elevators[index], index, monotonic_nsec());
+    controller->started = true;
+
+    set_lamps(&system->elevators[index], elevator_socket);
+    LOG_INFO("Resuming elevator %zu, state = %" PRIu8 ", floor = %" PRIu8 ", target = %" PRIu8 "\n", index,
+             system->elevators[index].state, system->elevators[index].current_floor,
+             system->elevators[index].target_floor);
+}
+
+void elevator_run(system_state_t *system, const uint16_t *ports, const size_t index, const size_t count,
+                  const bool resume)
+{
+    controller_t controllers[ELEVATOR_COUNT] = {0};
+    zone_view_t zone_view = {0};
+    received_t received = {0};
+    published_t published = {0};
+    failure_detector_t detector;
+
+    /* A replay reads the peers on the same host from the trace */
+    if (!trace_is_replaying() && local_peer_init(index, count) < 0)
+    {
+        LOG_WARNING("Shared memory ring unavailable, using UDP for all peers\n");
+    }
+    if (receiver_start(system->peer_socket, index, count) < 0)
+    {
+        LOG_WARNING("Receiving peer states in the control loop\n");
+    }
+    /* Calls pending when the process last stopped are restored before startup lights their lamps. A replay starts from
+     * the recorded state instead */
+    if (!trace_is_replaying() && journal_open(index, count, system->elevators) < 0)
+    {
+        LOG_WARNING("Order journal unavailable, calls are not persisted\n");
+    }
+
+    trace_state(system->elevators);
+
+    /* Elevators are set up once their hardware server is connected, which the control loop does without waiting. Until
+     * then they are disabled, so their peers do not count on them */
+    for (size_t i = 0; i < count; ++i)
+    {
+        controllers[i].index = index + i;
+        memset(controllers[i].assignment, ASSIGN_NONE, sizeof(controllers[i].assignment));
+        cluster_view_init(&controllers[i].view, index + i);
+        dwell_init(&controllers[i].dwell);
+        if (resume)
+        {
+            resume_controller(system, &controllers[i]);
+        }
+        else
+        {
+            system->elevators[index + i].state = ELEVATOR_STATE_IDLE;
+            system->elevators[index + i].disabled = 1;
+        }
+        travel_init(&controllers[i].travel, &system->elevators[index + i]);
+        trace_clock_gettime(CLOCK_REALTIME, &controllers[i].time);
+    }
+    events_init(system->elevators, index, count);
+    membership_init(ports, index, count);
+    join_init(index, count, resume);
+    detector_init(&detector);
+
+    /* The io_uring backend bypasses the trace, so it is only used when no trace is recorded or replayed */
+    if (!trace_is_recording() && !trace_is_replaying())
+    {
+        int err = uring_init();
+        if (err < 0 && err != -ENOSYS)
+        {
+            LOG_WARNING("io_uring unavailable, err = %d, using blocking I/O\n", -err);
+        }
+    }
+
+    /* After the receive thread is started, so only the control loop runs in real time */
+    realtime_enter();
+
+    while (!trace_is_finished()) // Main control loop, runs until the end of the trace when replaying
+    {
+        /* Take over the peer states received since the previous iteration. Peer datagrams are received on their own
+         * thread. All of them are taken over at once, so the decisions of this iteration see one consistent fleet */
+        const peer_snapshot_t *snapshot = receiver_snapshot();
+        membership_update(snapshot);
+        receive_states(system, snapshot, &detector, &zone_view, &received, index, count);
+        if (trace_is_finished())
+        {
+            break; // The trace ended within this iteration
+        }
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            connect_controller(system, &controllers[i]);
+            controller_poll(system, &controllers[i]);
+            /* Elevators in this process are always up to date with each other */
+            detector_heartbeat(&detector, index + i);
+        }
+        /* A joining process installs the snapshot a member answered with. Restored cab calls light up below */
+        join_update(snapshot, system->elevators, received.heard);
+
+        /* Publish local elevator states to peers on this host, and send them to the live remote members in the same
+         * zone. Zone digests are sent between zones, and gossip keeps the member list */
+        local_peer_publish(system->elevators);
+        if (publish_is_due(system, &published, index, count))
+        {
+            broadcast_states(system, index, count);
+            for (size_t i = 0; ZONE_COUNT > 1 && i < count; ++i)
+            {
+                if (is_representative(controllers[i].connected, index + i))
                 {
-                    continue;
+                    broadcast_digest(system, &zone_view, &controllers[i].time, index + i, index, count);
                 }
-                /* Valid hall DOWN order, start moving */
-                system->elevators[index].direction = ELEVATOR_DIRECTION_DOWN;
             }
+        }
+        send_gossip(system);
+        send_join(system, snapshot);
+        uring_submit();
 
-            /* Start moving UP or DOWN or opening doors depending on the relation between current_floor and target_floor
-             */
-            if (system->elevators[index].target_floor > system->elevators[index].current_floor)
-            {
-                system->elevators[index].state = ELEVATOR_STATE_MOVING;
-                disable_timer = elevator_times[index];
-                driver_set_motor_direction(system->elevator_socket, MOTOR_DIRECTION_UP);
-            }
-            if (system->elevators[index].target_floor < system->elevators[index].current_floor)
-            {
-                system->elevators[index].state = ELEVATOR_STATE_MOVING;
-                disable_timer = elevator_times[index];
-                driver_set_motor_direction(system->elevator_socket, MOTOR_DIRECTION_DOWN);
-            }
-            if (system->elevators[index].target_floor == system->elevators[index].current_floor)
-            {
-                system->elevators[index].state = ELEVATOR_STATE_OPEN;
-                driver_set_door_open_lamp(system->elevator_socket, 1);
-                clock_gettime(CLOCK_REALTIME, &door_timer);
-                door_timer.tv_sec += DOOR_OPEN_TIME_SEC;
-            }
-            break;
+        if (trace_is_finished())
+        {
+            break; // The trace ended within this iteration
+        }
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            controller_update(system, &controllers[i], &detector, &zone_view);
+            stats_elevator(index + i, &system->elevators[index + i], controllers[i].view.connected_count);
+            journal_record(index + i, system->elevators[index + i].floor_states);
         }
+        /* Calls polled and locks claimed in this iteration go out now instead of with the next periodic state */
+        send_events(system, snapshot, controllers, index, count);
+        uring_submit();
+        stats_loop();
+        trace_flush();
+
+        wait_for_work(system, controllers, count);
+        stats_loop_begin();
     }
-}
\ No newline at end of file
+}
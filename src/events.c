@@ -0,0 +1,132 @@
+#include <events.h>
+#include <orders.h>
+#include <string.h>
+#include <time.h>
+#include <trace.h>
+
+#define EVENT_RETRANSMIT_NSEC (10000000LL)
+#define EVENT_HALL_FLAGS (FLOOR_FLAG_BUTTON_UP | FLOOR_FLAG_BUTTON_DOWN | FLOOR_FLAG_LOCKED_UP | FLOOR_FLAG_LOCKED_DOWN)
+
+typedef struct
+{
+    peer_event_t event;
+    bool pending[ELEVATOR_COUNT]; // Recipients that did not acknowledge the event yet
+    int64_t sent;                 // CLOCK_MONOTONIC time of the last transmission in nanoseconds, 0 if not sent yet
+} pending_event_t;
+
+static pending_event_t slots[PEER_EVENT_SLOTS];
+static uint32_t sequence;
+static uint32_t state_sequence;
+static uint8_t tracked_states[ELEVATOR_COUNT][FLOOR_COUNT]; // Hall flags as of the last events_track
+static uint8_t tracked_locks[ELEVATOR_COUNT][2][FLOOR_COUNT];
+
+static int64_t monotonic_nsec(void)
+{
+    struct timespec time;
+    trace_clock_gettime(CLOCK_MONOTONIC, &time);
+    return (int64_t)time.tv_sec * 1000000000LL + time.tv_nsec;
+}
+
+static void track(const elevator_t *elevator, size_t index)
+{
+    for (size_t i = 0; i < FLOOR_COUNT; ++i)
+    {
+        tracked_states[index][i] = elevator->floor_states[i] & EVENT_HALL_FLAGS;
+        tracked_locks[index][0][i] = elevator->locking_elevator[0][i];
+        tracked_locks[index][1][i] = elevator->locking_elevator[1][i];
+    }
+}
+
+void events_init(const elevator_t *elevators, size_t first, size_t count)
+{
+    for (size_t i = first; i < first + count; ++i)
+    {
+        track(&elevators[i], i);
+    }
+}
+
+uint32_t events_state_sent(void)
+{
+    return ++state_sequence;
+}
+
+void events_track(const elevator_t *elevator, size_t index, const bool *recipients)
+{
+    bool any = false;
+    for (size_t i = 0; i < ELEVATOR_COUNT; ++i)
+    {
+        any |= recipients[i];
+    }
+
+    for (uint8_t i = 0; any && i < FLOOR_COUNT; ++i)
+    {
+        const uint8_t floor_state = elevator->floor_states[i] & EVENT_HALL_FLAGS;
+        bool changed = (floor_state & ~tracked_states[index][i]) != 0;
+        for (elevator_direction_t direction = ELEVATOR_DIRECTION_UP; direction <= ELEVATOR_DIRECTION_DOWN; ++direction)
+        {
+            changed |= (floor_state & direction_to_floor_flag_locked(direction)) &&
+                       elevator->locking_elevator[direction][i] != tracked_locks[index][direction][i];
+        }
+        if (!changed)
+        {
+            continue;
+        }
+
+        /* A full ring overwrites the oldest event, which then only reaches the peers with the periodic state */
+        pending_event_t *slot = &slots[++sequence % PEER_EVENT_SLOTS];
+        slot->event = (peer_event_t){.type = PEER_MESSAGE_TYPE_EVENT,
+                                     .index = index,
+                                     .floor = i,
+                                     .floor_state = floor_state,
+                                     .locking_elevator = {elevator->locking_elevator[0][i],
+                                                          elevator->locking_elevator[1][i]},
+                                     .sequence = sequence,
+                                     .state_sequence = state_sequence};
+        memcpy(slot->pending, recipients, sizeof(slot->pending));
+        slot->sent = 0;
+    }
+    track(elevator, index);
+}
+
+bool events_next(const peer_snapshot_t *snapshot, const elevator_t *elevators, const bool *connected,
+                 peer_event_t *event, bool *recipients)
+{
+    int64_t now = 0;
+    for (size_t i = 0; i < PEER_EVENT_SLOTS; ++i)
+    {
+        pending_event_t *slot = &slots[i];
+        if (slot->event.sequence == 0)
+        {
+            continue;
+        }
+
+        /* Once the call is completed or the lock handed over, the periodic state is what the peers need */
+        const uint8_t floor_state = elevators[slot->event.index].floor_states[slot->event.floor];
+        bool pending = (floor_state & slot->event.floor_state) == slot->event.floor_state;
+        for (size_t j = 0; pending && j < ELEVATOR_COUNT; ++j)
+        {
+            slot->pending[j] &= connected[j] && snapshot->acks[j][i] != slot->event.sequence;
+        }
+        bool waiting = false;
+        for (size_t j = 0; pending && j < ELEVATOR_COUNT; ++j)
+        {
+            waiting |= slot->pending[j];
+        }
+        if (!waiting)
+        {
+            slot->event.sequence = 0;
+            continue;
+        }
+
+        now = now != 0 ? now : monotonic_nsec();
+        if (slot->sent != 0 && now - slot->sent < EVENT_RETRANSMIT_NSEC)
+        {
+            continue;
+        }
+        slot->sent = now;
+        *event = slot->event;
+        memcpy(recipients, slot->pending, sizeof(slot->pending));
+        return true;
+    }
+    return false;
+}
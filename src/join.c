@@ -0,0 +1,217 @@
+#include <inttypes.h>
+#include <join.h>
+#include <log.h>
+#include <membership.h>
+#include <orders.h>
+#include <string.h>
+#include <time.h>
+#include <trace.h>
+
+#define JOIN_RETRY_NSEC (100000000LL)     // A request that is not answered by then goes to the next member
+#define JOIN_DISCOVERY_NSEC (1000000000LL) // Alone in the zone for this long, the process starts from its own state
+#define JOIN_TIMEOUT_NSEC (3000000000LL)
+
+static size_t own_first;
+static size_t own_count;
+static bool synced;
+static int64_t start;
+static int64_t last_request;
+static uint32_t first_nonce;               // Nonces of this process follow this one
+static uint32_t nonce;                     // Of the latest request
+static uint32_t sync_count;                // Answers taken over
+static int64_t joining[ELEVATOR_COUNT];    // Time members last answered that they are joining themselves, 0 if never
+static uint32_t answered[ELEVATOR_COUNT]; // Nonce of the last request answered, by first index of the joining process
+static size_t next_target;
+
+static int64_t monotonic_nsec(void)
+{
+    struct timespec time;
+    trace_clock_gettime(CLOCK_MONOTONIC, &time);
+    return (int64_t)time.tv_sec * 1000000000LL + time.tv_nsec;
+}
+
+static bool is_local(const size_t i)
+{
+    return i >= own_first && i < own_first + own_count;
+}
+
+static bool is_in_local_zone(const size_t i)
+{
+    return zone_of(i) >= zone_of(own_first) && zone_of(i) <= zone_of(own_first + own_count - 1);
+}
+
+/**
+ * @brief Checks whether elevator @p i is a live member of the zone that a request for its process goes to
+ */
+static bool is_candidate(const size_t i)
+{
+    return !is_local(i) && is_in_local_zone(i) && membership_is_live(i) && membership_contact(i) == i;
+}
+
+static size_t count_candidates(void)
+{
+    size_t candidates = 0;
+    for (size_t i = 0; i < ELEVATOR_COUNT; ++i)
+    {
+        candidates += is_candidate(i);
+    }
+    return candidates;
+}
+
+/**
+ * @brief Checks whether member @p i answered recently that it is joining itself. The answer holds for one round of
+ * requests over the @p candidates, after which the member is asked again, since it may have joined by then
+ */
+static bool is_joining(const size_t i, const int64_t now, const size_t candidates)
+{
+    return joining[i] != 0 && now - joining[i] < (int64_t)(candidates + 1) * JOIN_RETRY_NSEC;
+}
+
+void join_init(size_t first, size_t count, bool is_synced)
+{
+    own_first = first;
+    own_count = count;
+    synced = is_synced;
+    start = monotonic_nsec();
+
+    /* Nonces of a restarted process must differ from the ones its previous incarnation used */
+    struct timespec time;
+    trace_clock_gettime(CLOCK_REALTIME, &time);
+    first_nonce = (uint32_t)(time.tv_sec * 1000 + time.tv_nsec / 1000000);
+    nonce = first_nonce;
+}
+
+bool join_is_synced(void)
+{
+    return synced;
+}
+
+static void install(const peer_sync_t *sync, elevator_t *elevators, const bool *heard)
+{
+    uint8_t calls[FLOOR_COUNT] = {0};
+    for (size_t i = 0; i < ELEVATOR_COUNT; ++i)
+    {
+        if (is_local(i))
+        {
+            for (size_t j = 0; j < FLOOR_COUNT; ++j)
+            {
+                elevators[i].floor_states[j] |= sync->elevators[i].floor_states[j] & FLOOR_FLAG_BUTTON_CAB;
+            }
+        }
+        else if (is_in_local_zone(i) && !heard[i])
+        {
+            elevators[i] = sync->elevators[i];
+        }
+        for (size_t j = 0; j < FLOOR_COUNT; ++j)
+        {
+            calls[j] |= sync->elevators[i].floor_states[j];
+        }
+    }
+    size_t floors = 0;
+    for (size_t j = 0; j < FLOOR_COUNT; ++j)
+    {
+        floors += (calls[j] & (FLOOR_FLAG_BUTTON_UP | FLOOR_FLAG_BUTTON_DOWN | FLOOR_FLAG_BUTTON_CAB)) != 0;
+    }
+    LOG_INFO("Synchronized from elevator %u, version %" PRIu32 ", %zu floors with calls\n", sync->first_index,
+             sync->version, floors);
+}
+
+void join_update(const peer_snapshot_t *snapshot, elevator_t *elevators, const bool *heard)
+{
+    if (synced)
+    {
+        return;
+    }
+    const int64_t now = monotonic_nsec();
+    /* A late answer to an earlier attempt is as good as one to the latest */
+    const uint32_t attempt = snapshot->sync.nonce - first_nonce;
+    if (snapshot->sync_count != sync_count)
+    {
+        sync_count = snapshot->sync_count;
+        if (attempt != 0 && attempt <= nonce - first_nonce && snapshot->sync.ready)
+        {
+            install(&snapshot->sync, elevators, heard);
+            synced = true;
+            return;
+        }
+        if (attempt != 0 && attempt <= nonce - first_nonce)
+        {
+            joining[snapshot->sync.first_index] = now;
+        }
+    }
+
+    /* Members that start together are all joining. None of them has more than the others, so they start as they are */
+    const size_t candidates = count_candidates();
+    size_t joined = 0;
+    for (size_t i = 0; i < ELEVATOR_COUNT; ++i)
+    {
+        joined += is_candidate(i) && !is_joining(i, now, candidates);
+    }
+    const int64_t elapsed = now - start;
+    if (candidates > 0 && joined == 0)
+    {
+        LOG_INFO("All %zu members of the zone are joining, starting without a snapshot\n", candidates);
+        synced = true;
+    }
+    else if (candidates == 0 && elapsed >= JOIN_DISCOVERY_NSEC)
+    {
+        LOG_INFO("No members in the zone, starting without a snapshot\n");
+        synced = true;
+    }
+    else if (elapsed >= JOIN_TIMEOUT_NSEC)
+    {
+        LOG_WARNING("No snapshot received, starting without one\n");
+        synced = true;
+    }
+}
+
+bool join_request(peer_sync_request_t *request, struct sockaddr_in *address)
+{
+    const int64_t now = monotonic_nsec();
+    if (synced || now - last_request < JOIN_RETRY_NSEC)
+    {
+        return false;
+    }
+    const size_t candidates = count_candidates();
+    for (size_t k = 0; k < ELEVATOR_COUNT; ++k)
+    {
+        const size_t i = (next_target + k) % ELEVATOR_COUNT;
+        if (!is_candidate(i) || is_joining(i, now, candidates))
+        {
+            continue;
+        }
+        next_target = i + 1;
+        last_request = now;
+        *request = (peer_sync_request_t){.type = PEER_MESSAGE_TYPE_SYNC_REQUEST,
+                                         .first_index = own_first,
+                                         .count = own_count,
+                                         .nonce = ++nonce};
+        *address = *membership_address(i);
+        return true;
+    }
+    return false;
+}
+
+bool join_next_reply(const peer_snapshot_t *snapshot, const elevator_t *elevators, peer_sync_t *reply,
+                     struct sockaddr_in *address)
+{
+    for (size_t i = 0; i < ELEVATOR_COUNT; ++i)
+    {
+        const peer_sync_request_t *request = &snapshot->sync_requests[i];
+        if (request->type != PEER_MESSAGE_TYPE_SYNC_REQUEST || request->nonce == answered[i] || is_local(i))
+        {
+            continue;
+        }
+        answered[i] = request->nonce;
+        *reply = (peer_sync_t){.type = PEER_MESSAGE_TYPE_SYNC,
+                               .first_index = own_first,
+                               .count = own_count,
+                               .ready = synced,
+                               .nonce = request->nonce,
+                               .version = membership_version()};
+        memcpy(reply->elevators, elevators, sizeof(reply->elevators));
+        *address = snapshot->sync_sources[i];
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,300 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <journal.h>
+#include <log.h>
+#include <orders.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define JOURNAL_BUFFER_RECORDS (4096)
+/* Only cab calls are journaled. Hall calls are shared with the peers, which would adopt a hall call served while this
+ * node was down as a new one if it were restored */
+#define JOURNAL_BUTTONS (FLOOR_FLAG_BUTTON_CAB)
+
+typedef enum
+{
+    JOURNAL_RECORD_REGISTER = 1,
+    JOURNAL_RECORD_COMPLETE,
+} journal_record_type_t;
+
+typedef struct
+{
+    uint8_t type;
+    uint8_t elevator;
+    uint8_t floor;
+    uint8_t buttons;
+} journal_record_t;
+
+typedef struct
+{
+    size_t count;
+    journal_record_t records[JOURNAL_BUFFER_RECORDS];
+} journal_buffer_t;
+
+/* The control loop appends to the active buffer, the commit thread swaps it and writes the other one */
+static journal_buffer_t buffers[2];
+static journal_buffer_t *active = &buffers[0];
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static int journal_fd = -1;
+static uint8_t journaled[ELEVATOR_COUNT][FLOOR_COUNT]; // Buttons as of the last record, only used by the control loop
+static bool overflowed;
+
+static void journal_path(char *path, size_t size, size_t index, const char *suffix)
+{
+    (void)snprintf(path, size, "%s/elevator-%zu.journal%s", JOURNAL_DIR, index, suffix);
+}
+
+static int write_all(int fd, const void *data, size_t size)
+{
+    for (size_t written = 0; written < size;)
+    {
+        ssize_t result = write(fd, (const uint8_t *)data + written, size - written);
+        if (result == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -errno;
+        }
+        written += result;
+    }
+    return 0;
+}
+
+/**
+ * @brief Applies the journal at @p path to @p elevators. A record cut short by a crash ends the journal, and records
+ * for other elevators or of unknown types are skipped
+ */
+static void restore(const char *path, size_t index, size_t count, elevator_t *elevators)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd == -1)
+    {
+        return;
+    }
+    off_t size = lseek(fd, 0, SEEK_END);
+    journal_record_t *records = size > 0 ? malloc(size) : NULL;
+    if (records == NULL || pread(fd, records, size, 0) != size)
+    {
+        free(records);
+        (void)close(fd);
+        return;
+    }
+    (void)close(fd);
+
+    /* Replay into the button flags only, locks are agreed on again with the peers */
+    uint8_t buttons[ELEVATOR_COUNT][FLOOR_COUNT] = {0};
+    size_t applied = 0;
+    size_t skipped = 0;
+    for (size_t i = 0; i < size / sizeof(journal_record_t); ++i)
+    {
+        const journal_record_t *record = &records[i];
+        if (record->elevator < index || record->elevator >= index + count || record->floor >= FLOOR_COUNT)
+        {
+            ++skipped;
+            continue;
+        }
+        if (record->type == JOURNAL_RECORD_REGISTER)
+        {
+            buttons[record->elevator][record->floor] |= record->buttons & JOURNAL_BUTTONS;
+        }
+        else if (record->type == JOURNAL_RECORD_COMPLETE)
+        {
+            buttons[record->elevator][record->floor] &= ~record->buttons;
+        }
+        else
+        {
+            ++skipped;
+            continue;
+        }
+        ++applied;
+    }
+    free(records);
+
+    for (size_t i = index; i < index + count; ++i)
+    {
+        for (size_t j = 0; j < FLOOR_COUNT; ++j)
+        {
+            elevators[i].floor_states[j] |= buttons[i][j];
+        }
+    }
+    LOG_INFO("Restored %zu journal records\n", applied);
+    if (skipped > 0)
+    {
+        LOG_WARNING("Skipped %zu journal records for other elevators or of unknown types\n", skipped);
+    }
+}
+
+/**
+ * @brief Replaces the journal with one register record per pending call
+ */
+static int compact(size_t index, size_t count, const elevator_t *elevators)
+{
+    char path[256];
+    char temporary[256];
+    journal_path(path, sizeof(path), index, "");
+    journal_path(temporary, sizeof(temporary), index, ".tmp");
+
+    journal_buffer_t *snapshot = &buffers[1];
+    snapshot->count = 0;
+    for (size_t i = index; i < index + count; ++i)
+    {
+        for (size_t j = 0; j < FLOOR_COUNT; ++j)
+        {
+            journaled[i][j] = elevators[i].floor_states[j] & JOURNAL_BUTTONS;
+            if (journaled[i][j] != 0)
+            {
+                snapshot->records[snapshot->count++] = (journal_record_t){
+                    .type = JOURNAL_RECORD_REGISTER,
+                    .elevator = i,
+                    .floor = j,
+                    .buttons = journaled[i][j]};
+            }
+        }
+    }
+
+    int fd = open(temporary, O_WRONLY | O_CREAT | O_TRUNC, 0660);
+    if (fd == -1)
+    {
+        return -errno;
+    }
+    int err = write_all(fd, snapshot->records, snapshot->count * sizeof(journal_record_t));
+    if (err == 0 && fdatasync(fd) == -1)
+    {
+        err = -errno;
+    }
+    (void)close(fd);
+    snapshot->count = 0;
+    if (err == 0 && rename(temporary, path) == -1)
+    {
+        err = -errno;
+    }
+    if (err < 0)
+    {
+        return err;
+    }
+
+    /* The rename is only durable once the directory is synced */
+    int directory = open(JOURNAL_DIR, O_RDONLY | O_DIRECTORY);
+    if (directory != -1)
+    {
+        (void)fsync(directory);
+        (void)close(directory);
+    }
+    journal_fd = open(path, O_WRONLY | O_APPEND | O_CLOEXEC);
+    return journal_fd == -1 ? -errno : 0;
+}
+
+static void *commit_routine(void *arg)
+{
+    (void)arg;
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    while (1)
+    {
+        deadline.tv_nsec += JOURNAL_INTERVAL_MS * 1000000L;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+        deadline.tv_nsec %= 1000000000L;
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR)
+        {
+        }
+
+        /* Swap under the lock, write and sync outside of it, so the control loop never waits for the disk */
+        pthread_mutex_lock(&mutex);
+        journal_buffer_t *batch = active;
+        active = active == &buffers[0] ? &buffers[1] : &buffers[0];
+        if (overflowed)
+        {
+            LOG_ERROR("Journal buffer full, records were delayed\n");
+            overflowed = false;
+        }
+        pthread_mutex_unlock(&mutex);
+
+        if (batch->count == 0)
+        {
+            continue;
+        }
+        int err = write_all(journal_fd, batch->records, batch->count * sizeof(journal_record_t));
+        if (err == 0 && fdatasync(journal_fd) == -1)
+        {
+            err = -errno;
+        }
+        if (err < 0)
+        {
+            LOG_ERROR("Journal commit failed, err = %d\n", -err);
+        }
+        batch->count = 0;
+    }
+    return NULL;
+}
+
+int journal_open(size_t index, size_t count, elevator_t *elevators)
+{
+    char path[256];
+    journal_path(path, sizeof(path), index, "");
+    restore(path, index, count, elevators);
+
+    int err = compact(index, count, elevators);
+    if (err < 0)
+    {
+        LOG_ERROR("Could not open journal %s, err = %d\n", path, -err);
+        return err;
+    }
+
+    pthread_t thread;
+    err = pthread_create(&thread, NULL, commit_routine, NULL);
+    if (err != 0)
+    {
+        (void)close(journal_fd);
+        journal_fd = -1;
+        return -err;
+    }
+    return 0;
+}
+
+void journal_record(size_t index, const uint8_t *floor_states)
+{
+    if (journal_fd == -1)
+    {
+        return;
+    }
+    for (size_t i = 0; i < FLOOR_COUNT; ++i)
+    {
+        const uint8_t buttons = floor_states[i] & JOURNAL_BUTTONS;
+        const uint8_t registered = buttons & ~journaled[index][i];
+        const uint8_t completed = journaled[index][i] & ~buttons;
+        if (registered == 0 && completed == 0)
+        {
+            continue;
+        }
+
+        /* A record that does not fit is tried again on the next call, since journaled only follows what was appended */
+        pthread_mutex_lock(&mutex);
+        if (registered != 0 && active->count < JOURNAL_BUFFER_RECORDS)
+        {
+            active->records[active->count++] = (journal_record_t){
+                .type = JOURNAL_RECORD_REGISTER, .elevator = index, .floor = i, .buttons = registered};
+            journaled[index][i] |= registered;
+        }
+        else if (registered != 0)
+        {
+            overflowed = true;
+        }
+        if (completed != 0 && active->count < JOURNAL_BUFFER_RECORDS)
+        {
+            active->records[active->count++] = (journal_record_t){
+                .type = JOURNAL_RECORD_COMPLETE, .elevator = index, .floor = i, .buttons = completed};
+            journaled[index][i] &= ~completed;
+        }
+        else if (completed != 0)
+        {
+            overflowed = true;
+        }
+        pthread_mutex_unlock(&mutex);
+    }
+}
@@ -0,0 +1,229 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <local_peer.h>
+#include <log.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <trace.h>
+#include <unistd.h>
+
+#define LOCAL_PEER_RING_SIZE (8)
+#define LOCAL_PEER_TIMEOUT_NSEC (500000000LL)
+#define LOCAL_PEER_DISCOVERY_INTERVAL_NSEC (1000000000LL)
+
+typedef struct
+{
+    /* Seqlock sequence, odd while the slot is written and 2 * publication number once it is complete */
+    atomic_uint_fast64_t sequence;
+    elevator_t elevators[ELEVATOR_COUNT];
+} local_ring_slot_t;
+
+typedef struct
+{
+    atomic_uint_fast64_t head;
+    atomic_int_fast64_t heartbeat; // CLOCK_MONOTONIC time of the last publication in nanoseconds
+    uint8_t first_index;
+    uint8_t count;
+    local_ring_slot_t slots[LOCAL_PEER_RING_SIZE];
+} local_ring_t;
+
+static local_ring_t *own_ring;
+static size_t own_first;
+static size_t own_count;
+static local_ring_t *rings[ELEVATOR_COUNT];      // Rings by the first index of the publishing process
+static local_ring_t *peer_rings[ELEVATOR_COUNT]; // Rings by elevator index
+static uint_fast64_t last_heads[ELEVATOR_COUNT];
+static int64_t last_discovery;
+static bool connected[ELEVATOR_COUNT]; // As of the last local_peer_discover, so replay sees the recorded peers
+
+static int64_t monotonic_nsec(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (int64_t)time.tv_sec * 1000000000LL + time.tv_nsec;
+}
+
+static void ring_name(char *name, size_t size, size_t index)
+{
+    (void)snprintf(name, size, "/elevator-ring-%zu", index);
+}
+
+static local_ring_t *map_ring(size_t index, int flags, int prot)
+{
+    char name[32];
+    ring_name(name, sizeof(name), index);
+    int fd = shm_open(name, flags, 0660);
+    if (fd == -1)
+    {
+        return NULL;
+    }
+    if ((flags & O_CREAT) && ftruncate(fd, sizeof(local_ring_t)) == -1)
+    {
+        LOG_ERROR("ftruncate failed, err = %d\n", errno);
+        (void)close(fd);
+        return NULL;
+    }
+    local_ring_t *ring = mmap(NULL, sizeof(local_ring_t), prot, MAP_SHARED, fd, 0);
+    (void)close(fd);
+    if ((void *)ring == MAP_FAILED)
+    {
+        LOG_ERROR("mmap failed, err = %d\n", errno);
+        return NULL;
+    }
+    return ring;
+}
+
+static void discover_rings(void)
+{
+    int64_t now = monotonic_nsec();
+    if (last_discovery != 0 && now - last_discovery < LOCAL_PEER_DISCOVERY_INTERVAL_NSEC)
+    {
+        return;
+    }
+    last_discovery = now;
+
+    for (size_t i = 0; i < ELEVATOR_COUNT; ++i)
+    {
+        if (i == own_first || rings[i] != NULL)
+        {
+            continue;
+        }
+        rings[i] = map_ring(i, O_RDONLY, PROT_READ);
+    }
+
+    for (size_t i = 0; i < ELEVATOR_COUNT; ++i)
+    {
+        if (rings[i] == NULL || rings[i]->first_index != i)
+        {
+            continue;
+        }
+        for (size_t j = i; j < (size_t)rings[i]->first_index + rings[i]->count && j < ELEVATOR_COUNT; ++j)
+        {
+            if (j < own_first || j >= own_first + own_count)
+            {
+                peer_rings[j] = rings[i];
+            }
+        }
+    }
+}
+
+int local_peer_init(size_t index, size_t count)
+{
+    own_first = index;
+    own_count = count;
+    own_ring = map_ring(index, O_CREAT | O_RDWR, PROT_READ | PROT_WRITE);
+    if (own_ring == NULL)
+    {
+        return -errno;
+    }
+    own_ring->first_index = index;
+    own_ring->count = count;
+    discover_rings();
+    return 0;
+}
+
+void local_peer_publish(const elevator_t *elevators)
+{
+    if (own_ring == NULL)
+    {
+        return;
+    }
+    /* Single writer, so the head can be read relaxed. Readers only ever look at the newest slot, so a slot is not
+     * reused until LOCAL_PEER_RING_SIZE - 1 newer snapshots have been published */
+    uint_fast64_t head = atomic_load_explicit(&own_ring->head, memory_order_relaxed) + 1;
+    local_ring_slot_t *slot = &own_ring->slots[head % LOCAL_PEER_RING_SIZE];
+
+    atomic_store_explicit(&slot->sequence, 2 * head - 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    memcpy(&slot->elevators[own_first], &elevators[own_first], own_count * sizeof(elevator_t));
+    atomic_store_explicit(&slot->sequence, 2 * head, memory_order_release);
+    atomic_store_explicit(&own_ring->head, head, memory_order_release);
+    atomic_store_explicit(&own_ring->heartbeat, monotonic_nsec(), memory_order_release);
+}
+
+/**
+ * @brief Checks whether the ring of elevator @p i is still published by a live process
+ *
+ * @param i elevator index
+ * @return true if the state of @p i can be read from its ring
+ */
+static bool ring_is_live(size_t i)
+{
+    local_ring_t *ring = peer_rings[i];
+    if (ring == NULL)
+    {
+        return false;
+    }
+    /* A ring left behind by a process that died is treated as a remote peer again */
+    int64_t heartbeat = atomic_load_explicit(&ring->heartbeat, memory_order_acquire);
+    return monotonic_nsec() - heartbeat < LOCAL_PEER_TIMEOUT_NSEC && i >= ring->first_index &&
+           i < (size_t)ring->first_index + ring->count;
+}
+
+void local_peer_discover(void)
+{
+    /* Which peers are local decides where states and events are sent, so it is an input of the control loop */
+    if (trace_is_replaying())
+    {
+        (void)trace_replay(TRACE_EVENT_LOCAL, connected, sizeof(connected));
+        return;
+    }
+    discover_rings();
+    for (size_t i = 0; i < ELEVATOR_COUNT; ++i)
+    {
+        connected[i] = ring_is_live(i);
+    }
+    trace_record(TRACE_EVENT_LOCAL, connected, sizeof(connected), 0);
+}
+
+bool local_peer_is_connected(size_t i)
+{
+    return connected[i];
+}
+
+static int read_ring(size_t i, elevator_t *elevator)
+{
+    if (!ring_is_live(i))
+    {
+        return -ENOENT;
+    }
+    local_ring_t *ring = peer_rings[i];
+
+    while (1)
+    {
+        uint_fast64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        if (head == last_heads[i])
+        {
+            return 0;
+        }
+        local_ring_slot_t *slot = &ring->slots[head % LOCAL_PEER_RING_SIZE];
+        uint_fast64_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        if (sequence != 2 * head)
+        {
+            continue; // The writer lapped us, read the new head
+        }
+        elevator_t copy = slot->elevators[i];
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&slot->sequence, memory_order_relaxed) != sequence)
+        {
+            continue;
+        }
+        *elevator = copy;
+        last_heads[i] = head;
+        return 1;
+    }
+}
+
+int local_peer_read(size_t i, elevator_t *elevator)
+{
+    if (trace_is_replaying())
+    {
+        return trace_replay(TRACE_EVENT_SHARED, elevator, sizeof(*elevator));
+    }
+    int result = read_ring(i, elevator);
+    trace_record(TRACE_EVENT_SHARED, elevator, result == 1 ? sizeof(*elevator) : 0, result);
+    return result;
+}
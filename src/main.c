@@ -1,38 +1,84 @@
 #include <assert.h>
+#include <driver.h>
 #include <errno.h>
 #include <inttypes.h>
 #include <log.h>
 #include <netinet/in.h>
 #include <netinet/ip.h>
 #include <process.h>
+#include <realtime.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <string.h>
 #include <sys/socket.h>
 #include <sys/time.h>
+#include <trace.h>
 #include <unistd.h>
 
 int main(int argc, char **argv)
 {
     size_t index = 0;
+    size_t count = 1;
     uint8_t is_backup = 0;
+    const char *record_path = NULL;
+    const char *replay_path = NULL;
+    bool realtime = true;
+    int cpu = -1;
 
     while (1)
     {
         /* Parse command-line arguments */
-        switch (getopt(argc, argv, "i:b:"))
+        switch (getopt(argc, argv, "i:k:b:r:p:fc:"))
         {
         case 'i':
             /* Convert the input string to an unsigned long and store it in index. Each node in the system will have a
              * different index */
             sscanf(optarg, "%lu", &index);
             break;
+        case 'k':
+            /* Number of elevators, starting at index, that this process runs in a single control loop */
+            sscanf(optarg, "%lu", &count);
+            break;
         case 'b':
             /* Convert the input string to an unsigned 8-bit int and store it in is_backup */
             sscanf(optarg, "%" SCNu8, &is_backup);
             break;
+        case 'r':
+            /* Record every hardware reply, peer state and clock reading to a trace */
+            record_path = optarg;
+            break;
+        case 'p':
+            /* Replay a trace instead of running against hardware and peers */
+            replay_path = optarg;
+            break;
+        case 'f':
+            /* Replay as fast as possible instead of with the recorded timing */
+            realtime = false;
+            break;
+        case 'c':
+            /* Run the control loop in real-time mode on this CPU */
+            sscanf(optarg, "%d", &cpu);
+            break;
         case -1:
-            return process_init(!is_backup, index);
+            if (realtime_configure(cpu) < 0)
+            {
+                LOG_ERROR("Invalid CPU %d\n", cpu);
+                return -EINVAL;
+            }
+            if (replay_path != NULL)
+            {
+                return process_replay(replay_path, realtime);
+            }
+            if (count == 0 || index + count > ELEVATOR_COUNT)
+            {
+                LOG_ERROR("Invalid elevator range %zu..%zu\n", index, index + count);
+                return -EINVAL;
+            }
+            if (record_path != NULL && !is_backup && trace_record_open(record_path, index, count) < 0)
+            {
+                return -EIO;
+            }
+            return process_init(!is_backup, index, count);
         }
     }
 }
\ No newline at end of file
@@ -0,0 +1,212 @@
+#include <arpa/inet.h>
+#include <log.h>
+#include <membership.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+#include <trace.h>
+
+#define MEMBERSHIP_INTERVAL_NSEC (200000000LL)
+#define MEMBERSHIP_TIMEOUT_NSEC (3000000000LL)
+#define MEMBERSHIP_ANNOUNCE_NSEC (2000000000LL) // Seed ports of elevators that are not members are announced to
+#define MEMBERSHIP_FANOUT (2)
+
+typedef struct
+{
+    gossip_member_t entry; // As of the last update
+    struct sockaddr_in address;
+    int64_t heard; // CLOCK_MONOTONIC time the heartbeat last increased in nanoseconds
+    bool live;
+    bool joined;    // Since the last gossip round, which then also goes to the new member
+    uint8_t contact; // Lowest live member at the same address
+} member_t;
+
+static member_t members[ELEVATOR_COUNT];
+static uint8_t live[ELEVATOR_COUNT];
+static size_t live_count;
+static uint32_t version;
+static uint64_t incarnation;
+static uint32_t heartbeat;
+static uint16_t seeds[ELEVATOR_COUNT];
+static size_t own_first;
+static size_t own_count;
+static int64_t last_round;
+static int64_t last_announce;
+static size_t next_target;
+
+static int64_t monotonic_nsec(void)
+{
+    struct timespec time;
+    trace_clock_gettime(CLOCK_MONOTONIC, &time);
+    return (int64_t)time.tv_sec * 1000000000LL + time.tv_nsec;
+}
+
+static bool is_local(const size_t i)
+{
+    return i >= own_first && i < own_first + own_count;
+}
+
+void membership_init(const uint16_t *seed_ports, size_t first, size_t count)
+{
+    memcpy(seeds, seed_ports, sizeof(seeds));
+    own_first = first;
+    own_count = count;
+
+    /* The start time orders the incarnations of an elevator, so a restarted process replaces its old entry. It is kept in
+     * nanoseconds, so a process restarted, or a standby taking over, within the same second still has a newer one */
+    struct timespec time;
+    trace_clock_gettime(CLOCK_REALTIME, &time);
+    incarnation = (uint64_t)time.tv_sec * 1000000000ULL + (uint64_t)time.tv_nsec;
+}
+
+void membership_update(const peer_snapshot_t *snapshot)
+{
+    const int64_t now = monotonic_nsec();
+    live_count = 0;
+    for (size_t i = 0; i < ELEVATOR_COUNT; ++i)
+    {
+        member_t *member = &members[i];
+        const gossip_member_t *entry = &snapshot->members[i];
+        if (is_local(i))
+        {
+            continue;
+        }
+
+        if (entry->incarnation != 0 &&
+            (entry->incarnation != member->entry.incarnation || entry->heartbeat != member->entry.heartbeat))
+        {
+            const bool restarted = entry->incarnation != member->entry.incarnation;
+            member->entry = *entry;
+            member->address = (struct sockaddr_in){
+                .sin_family = AF_INET, .sin_port = entry->port, .sin_addr.s_addr = entry->address};
+            member->heard = now;
+            if (!member->live || restarted)
+            {
+                char address[INET_ADDRSTRLEN];
+                (void)inet_ntop(AF_INET, &member->address.sin_addr, address, sizeof(address));
+                LOG_INFO("Elevator %zu joined from %s:%u, incarnation %" PRIu64 "\n", i, address,
+                         ntohs(member->address.sin_port), entry->incarnation);
+                member->live = true;
+                member->joined = true;
+                ++version;
+            }
+        }
+        else if (member->live && now - member->heard > MEMBERSHIP_TIMEOUT_NSEC)
+        {
+            LOG_WARNING("Elevator %zu left\n", i);
+            member->live = false;
+            ++version;
+        }
+
+        if (member->live)
+        {
+            live[live_count++] = i;
+        }
+    }
+
+    /* Elevators run by the same process share its address and get its datagrams once */
+    for (size_t i = 0; i < live_count; ++i)
+    {
+        member_t *member = &members[live[i]];
+        member->contact = live[i];
+        for (size_t j = 0; j < i; ++j)
+        {
+            if (members[live[j]].entry.address == member->entry.address &&
+                members[live[j]].entry.port == member->entry.port)
+            {
+                member->contact = live[j];
+                break;
+            }
+        }
+    }
+}
+
+bool membership_is_live(size_t i)
+{
+    return members[i].live;
+}
+
+const struct sockaddr_in *membership_address(size_t i)
+{
+    return &members[i].address;
+}
+
+size_t membership_contact(size_t i)
+{
+    return members[i].contact;
+}
+
+size_t membership_live(const uint8_t **members)
+{
+    *members = live;
+    return live_count;
+}
+
+uint32_t membership_version(void)
+{
+    return version;
+}
+
+size_t membership_gossip(peer_gossip_t *gossip, size_t *size, struct sockaddr_in *targets)
+{
+    const int64_t now = monotonic_nsec();
+    if (last_round != 0 && now - last_round < MEMBERSHIP_INTERVAL_NSEC)
+    {
+        return 0;
+    }
+    last_round = now;
+    ++heartbeat;
+
+    /* Our own elevators, then every live member we know of */
+    gossip->type = PEER_MESSAGE_TYPE_GOSSIP;
+    gossip->first_index = own_first;
+    gossip->count = own_count;
+    gossip->member_count = 0;
+    for (size_t i = own_first; i < own_first + own_count; ++i)
+    {
+        gossip->members[gossip->member_count++] =
+            (gossip_member_t){.index = i, .incarnation = incarnation, .heartbeat = heartbeat};
+    }
+    for (size_t i = 0; i < live_count; ++i)
+    {
+        gossip->members[gossip->member_count++] = members[live[i]].entry;
+    }
+    *size = offsetof(peer_gossip_t, members[gossip->member_count]);
+
+    size_t target_count = 0;
+    bool chosen[ELEVATOR_COUNT] = {0};
+    for (size_t i = 0; i < live_count; ++i)
+    {
+        const uint8_t member = members[live[i]].contact;
+        if (members[live[i]].joined && !chosen[member])
+        {
+            chosen[member] = true;
+            targets[target_count++] = members[member].address;
+        }
+        members[live[i]].joined = false;
+    }
+    for (size_t i = 0; i < MEMBERSHIP_FANOUT && i < live_count; ++i)
+    {
+        const uint8_t member = members[live[next_target++ % live_count]].contact;
+        if (!chosen[member])
+        {
+            chosen[member] = true;
+            targets[target_count++] = members[member].address;
+        }
+    }
+
+    /* Announce to the elevators we do not know yet, so new nodes and healed partitions find each other */
+    if (live_count == 0 || last_announce == 0 || now - last_announce >= MEMBERSHIP_ANNOUNCE_NSEC)
+    {
+        last_announce = now;
+        for (size_t i = 0; i < ELEVATOR_COUNT; ++i)
+        {
+            if (!is_local(i) && !members[i].live)
+            {
+                targets[target_count++] = (struct sockaddr_in){
+                    .sin_family = AF_INET, .sin_port = htons(seeds[i]), .sin_addr.s_addr = INADDR_BROADCAST};
+            }
+        }
+    }
+    return target_count;
+}
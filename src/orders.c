@@ -0,0 +1,180 @@
+#include <orders.h>
+
+floor_flags_t direction_to_floor_flag_button(elevator_direction_t direction)
+{
+    static const uint8_t table[2] = {FLOOR_FLAG_BUTTON_UP, FLOOR_FLAG_BUTTON_DOWN};
+    return table[direction];
+}
+
+floor_flags_t direction_to_floor_flag_locked(elevator_direction_t direction)
+{
+    static const uint8_t table[2] = {FLOOR_FLAG_LOCKED_UP, FLOOR_FLAG_LOCKED_DOWN};
+    return table[direction];
+}
+
+size_t zone_of(const size_t i)
+{
+    return i / ZONE_SIZE;
+}
+
+void register_peer_orders(elevator_t *elevator, const size_t index, elevator_t *peer, const size_t peer_index,
+                          const size_t zone)
+{
+    for (size_t j = 0; j < FLOOR_COUNT; ++j)
+    {
+        for (elevator_direction_t direction = ELEVATOR_DIRECTION_UP; direction <= ELEVATOR_DIRECTION_DOWN; ++direction)
+        {
+            const uint8_t button = direction_to_floor_flag_button(direction);
+            const uint8_t locked = direction_to_floor_flag_locked(direction);
+
+            if (elevator->floor_states[j] & button)
+            {
+                if (elevator->floor_states[j] & locked)
+                {
+                    /* If the holder itself gave up the lock, the call is open for the other elevators again */
+                    if (zone == ZONE_COUNT && elevator->locking_elevator[direction][j] == peer_index &&
+                        (peer->floor_states[j] & (locked | button)) == button)
+                    {
+                        elevator->floor_states[j] &= ~locked;
+                        elevator->locking_elevator[direction][j] = 255;
+                        continue;
+                    }
+
+                    /* If order was completed by a different elevator. A digest from another zone can only complete
+                     * orders locked by an elevator in that zone */
+                    if ((peer->floor_states[j] & (locked | button)) == 0 &&
+                        (zone == ZONE_COUNT || zone_of(elevator->locking_elevator[direction][j]) == zone))
+                    {
+                        elevator->floor_states[j] &= ~(button | locked);
+                    }
+
+                    /* If both elevators have the floor locked, they need to ensure they agree on who takes the
+                     * order */
+                    if (peer->floor_states[j] & locked)
+                    {
+                        if (peer->locking_elevator[direction][j] < elevator->locking_elevator[direction][j] ||
+                            elevator->disabled) // Prioritize based on index
+                        {
+                            elevator->locking_elevator[direction][j] = peer->locking_elevator[direction][j];
+                        }
+                        else
+                        {
+                            peer->locking_elevator[direction][j] = elevator->locking_elevator[direction][j];
+                        }
+                    }
+                }
+                /* If our elevator is not locking, but the other elevator is locking. Locking is important to
+                 * communicate, so that we agree that the elevator can take the call. A lock recorded for ourselves is
+                 * one we gave up, which the peer has not seen yet */
+                else if ((peer->floor_states[j] & locked) && peer->locking_elevator[direction][j] != index)
+                {
+                    elevator->floor_states[j] |= locked;
+                    elevator->locking_elevator[direction][j] = peer->locking_elevator[direction][j];
+                }
+            }
+            /* In this case our elevator is not aware of any calls, but will update its state if any other elevators
+             * have a call registered */
+            else if ((peer->floor_states[j] & button) && ((peer->floor_states[j] & locked) == 0))
+            {
+                elevator->floor_states[j] |= button;
+            }
+            /* Calls already locked in another zone never went through our zone, adopt both the call and the lock. Only
+             * the zone holding the lock speaks for it, so a completed order is not brought back by a stale digest */
+            else if ((peer->floor_states[j] & button) && zone != ZONE_COUNT &&
+                     zone_of(peer->locking_elevator[direction][j]) == zone)
+            {
+                elevator->floor_states[j] |= button | locked;
+                elevator->locking_elevator[direction][j] = peer->locking_elevator[direction][j];
+            }
+        }
+    }
+}
+
+void register_orders(elevator_t *elevators, const bool *connected, const size_t index)
+{
+    for (size_t i = 0; i < ELEVATOR_COUNT; ++i)
+    {
+        /* Iterates through all elevators, excludig itself and disconnected elevators */
+        if (i == index || !connected[i])
+        {
+            continue;
+        }
+        register_peer_orders(&elevators[index], index, &elevators[i], i, ZONE_COUNT);
+    }
+}
+
+bool floor_is_locked(const elevator_t *elevators, const bool *connected, const size_t index)
+{
+    /* Check if the elevator is actively handling a request at this floor */
+    if ((elevators[index].floor_states[elevators[index].current_floor] & FLOOR_FLAG_BUTTON_CAB) == 0 &&
+        elevators[index].current_floor != elevators[index].target_floor)
+    {
+        for (size_t i = 0; i < ELEVATOR_COUNT; ++i)
+        {
+            /* Skip disconnected elevators */
+            if (!connected[i])
+            {
+                continue;
+            }
+            /* If any elevator does not have the floor locked in either direction, return false */
+            if (((elevators[i].floor_states[elevators[index].current_floor] &
+                  direction_to_floor_flag_locked(elevators[index].direction)) == 0) ||
+                elevators[i].locking_elevator[elevators[index].direction][elevators[index].current_floor] != index)
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool order_is_available(const elevator_t *elevators, const bool *connected, elevator_direction_t direction,
+                        uint8_t floor)
+{
+    for (size_t i = 0; i < ELEVATOR_COUNT; ++i)
+    {
+        if (!connected[i])
+        {
+            continue;
+        }
+        /* If any active elevator has a button request for this floor in the given direction, or if any has already
+         * locked it, then the order is not available */
+        if ((elevators[i].floor_states[floor] & direction_to_floor_flag_button(direction)) == 0 ||
+            ((elevators[i].floor_states[floor] & direction_to_floor_flag_locked(direction)) != 0))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool verify_locked_floors(elevator_t *elevators, const bool *connected, elevator_direction_t direction,
+                          const size_t index)
+{
+    for (size_t i = 0; i < ELEVATOR_COUNT; ++i)
+    {
+        /* Locks held in other zones are arbitrated through the zone digests */
+        if (zone_of(i) != zone_of(index))
+        {
+            continue;
+        }
+        if (!connected[i] ||
+            (elevators[i].disabled && elevators[index].target_floor != elevators[i].current_floor))
+        {
+            /* If a disconnected elevator was recorded as the lock holder, take over the lock */
+            if (elevators[index].locking_elevator[direction][elevators[index].target_floor] == i)
+            {
+                elevators[index].locking_elevator[direction][elevators[index].target_floor] = index;
+            }
+            continue;
+        }
+
+        /* Elevators must agree on who owns the lock for the target floor */
+        if (elevators[index].locking_elevator[direction][elevators[index].target_floor] !=
+            elevators[i].locking_elevator[direction][elevators[index].target_floor])
+        {
+            return false;
+        }
+    }
+    return true;
+}
@@ -2,89 +2,400 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <log.h>
+#include <poll.h>
 #include <process.h>
 #include <pthread.h>
-#include <semaphore.h>
+#include <realtime.h>
+#include <stats.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
 #include <sys/shm.h>
+#include <sys/socket.h>
 #include <sys/time.h>
+#include <sys/un.h>
 #include <sys/wait.h>
 #include <time.h>
+#include <trace.h>
 #include <unistd.h>
 
+#define PROCESS_STANDBY_TIMEOUT_MS (5000) // A new backup is started when none has connected for this long
+#define PROCESS_DRAIN_TIMEOUT_MS (10)      // Replies to requests of a failed primary arrive within this time
+#define PROCESS_BIND_TIMEOUT_MS (100)
+#define PROCESS_PEER_PORT (10042)
+
 typedef struct
 {
-    sem_t primary_sem;
-    sem_t backup_sem;
     system_state_t state;
 } shared_memory_t;
 
+typedef struct
+{
+    size_t index;
+    size_t count;
+    int listen_fd;
+} process_args_t;
+
 static shared_memory_t *shared_memory;
+static uint16_t ports[ELEVATOR_COUNT]; // Elevator i listens on PROCESS_PEER_PORT + i, where new members announce themselves
+static process_args_t args;
+
+static void init_ports(void)
+{
+    for (size_t i = 0; i < ELEVATOR_COUNT; ++i)
+    {
+        ports[i] = PROCESS_PEER_PORT + i;
+    }
+}
+
+static struct sockaddr_in hardware_address(size_t index)
+{
+    return (struct sockaddr_in){
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK), .sin_port = htons(15657 + index), .sin_family = AF_INET};
+}
+
+static socklen_t standby_address(struct sockaddr_un *address, size_t index)
+{
+    /* Abstract socket, so the name disappears with the primary and needs no cleanup */
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    int length = snprintf(address->sun_path + 1, sizeof(address->sun_path) - 1, "elevator-standby-%zu", index);
+    return offsetof(struct sockaddr_un, sun_path) + 1 + length;
+}
+
+/**
+ * @brief Sends the peer socket and the hardware sockets of the elevators run by this process to the standby
+ *
+ * @param fd connection to the standby
+ * @return error code
+ * @retval 0 on success, otherwise negative error code
+ */
+static int send_sockets(int fd)
+{
+    int fds[ELEVATOR_COUNT + 1];
+    fds[0] = shared_memory->state.peer_socket;
+    memcpy(&fds[1], &shared_memory->state.elevator_sockets[args.index], args.count * sizeof(int));
+
+    uint8_t count = args.count;
+    struct iovec iov = {.iov_base = &count, .iov_len = sizeof(count)};
+    union {
+        struct cmsghdr header;
+        uint8_t buffer[CMSG_SPACE(sizeof(fds))];
+    } control = {0};
+    struct msghdr message = {
+        .msg_iov = &iov, .msg_iovlen = 1, .msg_control = control.buffer, .msg_controllen = CMSG_SPACE(sizeof(fds))};
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&message);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN((args.count + 1) * sizeof(int));
+    memcpy(CMSG_DATA(cmsg), fds, (args.count + 1) * sizeof(int));
+    message.msg_controllen = CMSG_SPACE((args.count + 1) * sizeof(int));
+
+    if (sendmsg(fd, &message, MSG_NOSIGNAL) == -1)
+    {
+        return -errno;
+    }
+    return 0;
+}
+
+/**
+ * @brief Receives the sockets sent by send_sockets. They refer to the connections the primary had when it sent them
+ *
+ * @param fd connection to the primary
+ * @param peer_socket set to the peer socket
+ * @param elevator_sockets set to the hardware sockets, array with length equal to ELEVATOR_COUNT
+ * @return error code
+ * @retval 0 on success, otherwise negative error code
+ */
+static int receive_sockets(int fd, socket_t *peer_socket, socket_t *elevator_sockets)
+{
+    int fds[ELEVATOR_COUNT + 1];
+    uint8_t count;
+    struct iovec iov = {.iov_base = &count, .iov_len = sizeof(count)};
+    union {
+        struct cmsghdr header;
+        uint8_t buffer[CMSG_SPACE(sizeof(fds))];
+    } control;
+    struct msghdr message = {
+        .msg_iov = &iov, .msg_iovlen = 1, .msg_control = control.buffer, .msg_controllen = sizeof(control.buffer)};
+    if (recvmsg(fd, &message, MSG_CMSG_CLOEXEC) != sizeof(count))
+    {
+        return -EIO;
+    }
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&message);
+    if (cmsg == NULL || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS || count != args.count ||
+        cmsg->cmsg_len != CMSG_LEN((count + 1) * sizeof(int)))
+    {
+        LOG_ERROR("Unexpected sockets from the primary\n");
+        return -EPROTO;
+    }
+    memcpy(fds, CMSG_DATA(cmsg), (count + 1) * sizeof(int));
+    *peer_socket = fds[0];
+    memcpy(&elevator_sockets[args.index], &fds[1], count * sizeof(int));
+    return 0;
+}
 
-static void *signal_primary_routine(void *arg)
+/**
+ * @brief Discards replies the hardware server sent to requests of the failed primary, so the next reply read belongs
+ * to the next request
+ *
+ * @param sock hardware socket
+ */
+static void drain_socket(socket_t sock)
 {
-    sem_t *incrementing_sem = &shared_memory->primary_sem;
-    sem_t *decrementing_sem = &shared_memory->backup_sem;
+    struct pollfd fd = {.fd = sock, .events = POLLIN};
+    uint8_t buffer[64];
+    while (poll(&fd, 1, PROCESS_DRAIN_TIMEOUT_MS) > 0 && recv(sock, buffer, sizeof(buffer), MSG_DONTWAIT) > 0)
+    {
+    }
+}
 
-    char command[128];
+static void *standby_routine(void *arg)
+{
+    (void)arg;
+    char command[160];
     (void)snprintf(command, sizeof(command),
-                   "unset GTK_PATH; gnome-terminal -- bash -c \"./elevator -i %d -b 1; exec bash\"",
-                   (uint16_t)(*((uint8_t *)arg)));
+                   "unset GTK_PATH; gnome-terminal -- bash -c \"./elevator -i %zu -k %zu -c %d -b 1; exec bash\"",
+                   args.index, args.count, realtime_cpu());
 
-    struct timespec time;
-    clock_gettime(CLOCK_REALTIME, &time);
-    time.tv_sec += 4;
     while (1)
     {
-        sleep(5);
-        if (sem_timedwait(decrementing_sem, &time) == 0)
+        struct pollfd listen_fd = {.fd = args.listen_fd, .events = POLLIN};
+        int ready = poll(&listen_fd, 1, PROCESS_STANDBY_TIMEOUT_MS);
+        if (ready == -1 && errno == EINTR)
         {
-            sem_post(incrementing_sem);
+            continue;
         }
-        else
+        if (ready == -1)
         {
-            LOG_INFO("Starting backup process");
+            LOG_ERROR("Could not wait for a hot standby, poll failed, err = %d\n", errno);
+            return NULL;
+        }
+        if (ready == 0)
+        {
+            LOG_INFO("Starting backup process\n");
             system(command);
+            continue;
+        }
+        int fd = accept(args.listen_fd, NULL, NULL);
+        if (fd == -1)
+        {
+            continue;
         }
+        if (send_sockets(fd) < 0)
+        {
+            LOG_ERROR("Could not hand the sockets to the backup, err = %d\n", errno);
+            (void)close(fd);
+            continue;
+        }
+        LOG_INFO("Hot standby connected\n");
+
+        /* The connection is only used to notice that the standby is gone */
+        struct pollfd standby = {.fd = fd, .events = POLLIN};
+        uint8_t byte;
+        while (((ready = poll(&standby, 1, -1)) == -1 && errno == EINTR) ||
+               (ready > 0 && recv(fd, &byte, sizeof(byte), MSG_DONTWAIT) > 0))
+        {
+        }
+        if (ready == -1)
+        {
+            /* Closing the connection would make the standby take over, so it is kept without being watched */
+            LOG_ERROR("Could not watch the hot standby, poll failed, err = %d\n", errno);
+            return NULL;
+        }
+        LOG_WARNING("Hot standby lost\n");
+        (void)close(fd);
     }
 
     return NULL;
 }
 
-static void *signal_backup_routine(void *arg)
+/**
+ * @brief Creates the peer socket and connects to the hardware servers
+ */
+static void open_sockets(void)
 {
-    sem_t *decrementing_sem = &shared_memory->primary_sem;
-    sem_t *incrementing_sem = &shared_memory->backup_sem;
+    /* Creating and checking the peer socet */
+    struct sockaddr_in addr_in = {
+        .sin_addr.s_addr = htonl(INADDR_ANY), .sin_port = htons(ports[args.index]), .sin_family = AF_INET};
 
-    char command[128];
-    (void)snprintf(command, sizeof(command),
-                   "unset GTK_PATH; gnome-terminal -- bash -c \"./elevator -i %d -b 0; exec bash\"",
-                   (uint16_t)(*((uint8_t *)arg)));
+    int err = 0;
+    socklen_t error_code_size = sizeof(err);
+    int retval = getsockopt(shared_memory->state.peer_socket, SOL_SOCKET, SO_ERROR, &err,
+                            &error_code_size); // Check if the socket is already initialized
 
-    struct timespec time;
-    clock_gettime(CLOCK_REALTIME, &time);
-    time.tv_sec += 4;
-    while (1)
+    if (err != 0 || retval == -1)
     {
-        sleep(5);
-        if (sem_timedwait(decrementing_sem, &time) == 0)
+        LOG_INFO("Initializing peer socket\n");
+        shared_memory->state.peer_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        if (shared_memory->state.peer_socket == -1)
         {
-            sem_post(incrementing_sem);
+            LOG_ERROR("socket init error = %d\n", errno);
         }
-        else
+
+        int value = 1;
+        if (setsockopt(shared_memory->state.peer_socket, SOL_SOCKET, SO_REUSEADDR, &value, sizeof(value)) == -1)
         {
-            LOG_INFO("Starting main process\n");
-            system(command);
+            LOG_ERROR("Set reusable error = %d\n", errno);
+            (void)close(shared_memory->state.peer_socket);
+        }
+        if (setsockopt(shared_memory->state.peer_socket, SOL_SOCKET, SO_BROADCAST, &value, sizeof(value)) == -1)
+        {
+            LOG_ERROR("Set broadcast error = %d\n", errno);
+            (void)close(shared_memory->state.peer_socket);
+        }
+
+        struct timeval time = {.tv_usec = 1, .tv_sec = 0};
+        if (setsockopt(shared_memory->state.peer_socket, SOL_SOCKET, SO_RCVTIMEO, &time, sizeof(time)) == -1)
+        {
+            LOG_ERROR("Set timeout error = %d\n", errno);
+            (void)close(shared_memory->state.peer_socket);
+        }
+
+        if (bind(shared_memory->state.peer_socket, (struct sockaddr *)&addr_in, sizeof(addr_in)) == -1)
+        {
+            LOG_ERROR("Bind failed error = %d\n", errno);
+            (void)close(shared_memory->state.peer_socket);
         }
     }
 
-    return NULL;
+    /* Initializing the elevator systems, one hardware connection per local elevator. The control loop completes the
+     * connections, so a hardware server that is not up yet does not hold it up */
+    for (size_t i = args.index; i < args.index + args.count; ++i)
+    {
+        const struct sockaddr_in address = hardware_address(i);
+        shared_memory->state.elevator_sockets[i] = driver_init(&address);
+        if (shared_memory->state.elevator_sockets[i] < 0)
+        {
+            LOG_ERROR("Could not connect to hardware server %zu, err = %d\n", i,
+                      -shared_memory->state.elevator_sockets[i]);
+        }
+    }
 }
 
-int process_init(bool is_primary, size_t index)
+/**
+ * @brief Runs the control loop, and serves the sockets to a hot standby
+ *
+ * @param resume whether the sockets were taken over from a failed primary
+ * @return error code
+ * @retval 0 on success, otherwise negative error code
+ */
+static int run_primary(bool resume)
 {
+    struct sockaddr_un address;
+    socklen_t size = standby_address(&address, args.index);
+    args.listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (args.listen_fd == -1)
+    {
+        LOG_ERROR("socket init error = %d\n", errno);
+        return -errno;
+    }
+    /* The name of a failed primary is released when its last descriptor is closed, which may be a moment after the
+     * standby noticed */
+    int retries = PROCESS_BIND_TIMEOUT_MS;
+    while (bind(args.listen_fd, (struct sockaddr *)&address, size) == -1)
+    {
+        if (errno != EADDRINUSE || retries-- == 0)
+        {
+            LOG_ERROR("Bind failed error = %d\n", errno);
+            (void)close(args.listen_fd);
+            return -errno;
+        }
+        (void)usleep(1000);
+    }
+    if (listen(args.listen_fd, 1) == -1)
+    {
+        LOG_ERROR("listen failed, err = %d\n", errno);
+        (void)close(args.listen_fd);
+        return -errno;
+    }
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, standby_routine, NULL);
+
+    /* Live statistics for elevator-top, next to the state shared with the backup */
+    if (stats_init(args.index, args.count) < 0)
+    {
+        LOG_WARNING("Statistics unavailable\n");
+    }
+
+    elevator_run(&shared_memory->state, ports, args.index, args.count, resume);
+
+    return 0;
+}
+
+/**
+ * @brief Waits as a hot standby for the primary to fail, then takes over its sockets and its state
+ *
+ * @return error code
+ * @retval 0 on success, otherwise negative error code
+ */
+static int run_standby(void)
+{
+    struct sockaddr_un address;
+    socklen_t size = standby_address(&address, args.index);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1)
+    {
+        LOG_ERROR("socket init error = %d\n", errno);
+        return -errno;
+    }
+    struct timespec start;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (connect(fd, (struct sockaddr *)&address, size) == -1)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if ((now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000 > PROCESS_STANDBY_TIMEOUT_MS)
+        {
+            LOG_INFO("No primary found, starting as primary\n");
+            (void)close(fd);
+            open_sockets();
+            return run_primary(false);
+        }
+        (void)usleep(100000);
+    }
+
+    socket_t peer_socket;
+    socket_t elevator_sockets[ELEVATOR_COUNT];
+    int err = receive_sockets(fd, &peer_socket, elevator_sockets);
+    if (err < 0)
+    {
+        (void)close(fd);
+        return err;
+    }
+    LOG_INFO("Hot standby ready\n");
+
+    /* The primary never writes to the connection, so it only returns once the primary is gone */
+    uint8_t byte;
+    ssize_t length;
+    while ((length = recv(fd, &byte, sizeof(byte), 0)) > 0 || (length == -1 && errno == EINTR))
+    {
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    (void)close(fd);
+
+    /* The hardware kept running and the state in shared memory is as the primary left it */
+    shared_memory->state.peer_socket = peer_socket;
+    for (size_t i = args.index; i < args.index + args.count; ++i)
+    {
+        const struct sockaddr_in address = hardware_address(i);
+        shared_memory->state.elevator_sockets[i] = elevator_sockets[i];
+        drain_socket(elevator_sockets[i]);
+        (void)driver_resume(elevator_sockets[i], &address);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    LOG_WARNING("Primary lost, took over in %.1f ms\n",
+                (now.tv_sec - start.tv_sec) * 1e3 + (now.tv_nsec - start.tv_nsec) / 1e6);
+    return run_primary(true);
+}
+
+int process_init(bool is_primary, size_t index, size_t count)
+{
+    args = (process_args_t){.index = index, .count = count, .listen_fd = -1};
+    init_ports();
+
     /* Creating and mapping a shared memory object */
     char file_name[7] = {index + 'A', '.', 't', 'e', 'm', 'p', '\0'};
 
@@ -103,89 +414,34 @@ int process_init(bool is_primary, size_t index)
         return -errno;
     }
 
-    if (sem_trywait(&shared_memory->primary_sem) == -1 &&
-        errno == EINVAL) // Check if semaphores are already initialized
+    if (!is_primary)
     {
-        if (sem_init(&shared_memory->primary_sem, 1, 1) == -1)
-        {
-            LOG_ERROR("sem_init failed, err = %d\n", errno);
-            return -errno;
-        }
-        if (sem_init(&shared_memory->backup_sem, 1, 0) == -1)
-        {
-            LOG_ERROR("sem_init failed, err = %d\n", errno);
-            return -errno;
-        }
-        LOG_INFO("Initialized semaphores");
-    }
-    else
-    {
-        sem_post(&shared_memory->primary_sem);
+        return run_standby();
     }
 
-    uint16_t ports[ELEVATOR_COUNT] = {10042, 10043, 10044}; // Ports for the elevators - changeble if needed
-    pthread_t thread;
-    if (is_primary)
-    {
-        /* Creating and checking the peer socet */
-        struct sockaddr_in addr_in = {
-            .sin_addr.s_addr = htonl(INADDR_ANY), .sin_port = htons(ports[index]), .sin_family = AF_INET};
-
-        int err = 0;
-        socklen_t error_code_size = sizeof(err);
-        int retval = getsockopt(shared_memory->state.peer_socket, SOL_SOCKET, SO_ERROR, &err,
-                                &error_code_size); // Check if the socket is already initialized
-
-        if (err != 0 || retval == -1)
-        {
-            LOG_INFO("Initializing peer socket\n");
-            shared_memory->state.peer_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
-            if (shared_memory->state.peer_socket == -1)
-            {
-                LOG_ERROR("socket init error = %d\n", errno);
-            }
-
-            int value = 1;
-            if (setsockopt(shared_memory->state.peer_socket, SOL_SOCKET, SO_REUSEADDR, &value, sizeof(value)) == -1)
-            {
-                LOG_ERROR("Set reusable error = %d\n", errno);
-                (void)close(shared_memory->state.peer_socket);
-            }
-            if (setsockopt(shared_memory->state.peer_socket, SOL_SOCKET, SO_BROADCAST, &value, sizeof(value)) == -1)
-            {
-                LOG_ERROR("Set broadcast error = %d\n", errno);
-                (void)close(shared_memory->state.peer_socket);
-            }
-
-            struct timeval time = {.tv_usec = 1, .tv_sec = 0};
-            if (setsockopt(shared_memory->state.peer_socket, SOL_SOCKET, SO_RCVTIMEO, &time, sizeof(time)) == -1)
-            {
-                LOG_ERROR("Set timeout error = %d\n", errno);
-                (void)close(shared_memory->state.peer_socket);
-            }
-
-            if (bind(shared_memory->state.peer_socket, (struct sockaddr *)&addr_in, sizeof(addr_in)) == -1)
-            {
-                LOG_ERROR("Bind failed error = %d\n", errno);
-                (void)close(shared_memory->state.peer_socket);
-            }
-        }
-
-        /* Initializing the elevator system */
-        addr_in.sin_port = htons(15657 + index);
-        shared_memory->state.elevator_socket = driver_init(&addr_in);
+    open_sockets();
+    return run_primary(false);
+}
 
-        pthread_create(&thread, NULL, signal_primary_routine, &index);
-    }
-    else
+int process_replay(const char *path, bool realtime)
+{
+    size_t index;
+    size_t count;
+    init_ports();
+    int err = trace_replay_open(path, realtime, &index, &count);
+    if (err < 0)
     {
-        /* Creating backup routine */
-        pthread_create(&thread, NULL, signal_backup_routine, &index);
-        pthread_join(thread, NULL);
-        return 0;
+        return err;
     }
 
-    elevator_run(&shared_memory->state, ports, index);
+    /* No hardware, peers or backup. The initial state and every input come from the trace */
+    system_state_t state = {.peer_socket = -1};
+    for (size_t i = 0; i < ELEVATOR_COUNT; ++i)
+    {
+        state.elevator_sockets[i] = -2 - (int)i; // Never used for I/O, but the driver tells the elevators apart by them
+    }
+    elevator_run(&state, ports, index, count, false);
+    trace_close();
 
     return 0;
 }
\ No newline at end of file
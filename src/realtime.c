@@ -0,0 +1,109 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <log.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <realtime.h>
+#include <sched.h>
+#include <stats.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#define REALTIME_STACK_PREFAULT (512 * 1024)
+#define REALTIME_JITTER_REPORT_SEC (10) // Worst wake-up latency is logged this often
+
+static int configured_cpu = -1;
+static int64_t worst_latency;
+static int64_t next_report;
+
+static int64_t timespec_nsec(const struct timespec *time)
+{
+    return (int64_t)time->tv_sec * 1000000000LL + time->tv_nsec;
+}
+
+static void prefault_stack(void)
+{
+    /* Touch the stack the control loop will grow into, so it is mapped and locked before the loop starts */
+    volatile uint8_t stack[REALTIME_STACK_PREFAULT];
+    for (size_t i = 0; i < sizeof(stack); i += 4096)
+    {
+        stack[i] = 0;
+    }
+}
+
+void realtime_woke(int64_t deadline)
+{
+    if (configured_cpu < 0)
+    {
+        return;
+    }
+    /* The clock is read directly, a measurement must not become part of a recorded trace */
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    const int64_t now = timespec_nsec(&time);
+    const int64_t latency = now - deadline;
+    stats_wakeup_latency(latency);
+    worst_latency = latency > worst_latency ? latency : worst_latency;
+    if (next_report == 0)
+    {
+        next_report = now + REALTIME_JITTER_REPORT_SEC * 1000000000LL;
+    }
+    else if (now >= next_report)
+    {
+        LOG_INFO("Worst wake-up latency %.1f us in the last %d s\n", worst_latency / 1e3, REALTIME_JITTER_REPORT_SEC);
+        worst_latency = 0;
+        next_report += REALTIME_JITTER_REPORT_SEC * 1000000000LL;
+    }
+}
+
+int realtime_configure(int cpu)
+{
+    if (cpu < -1 || cpu >= sysconf(_SC_NPROCESSORS_CONF) || cpu >= CPU_SETSIZE)
+    {
+        return -EINVAL;
+    }
+    configured_cpu = cpu;
+    return 0;
+}
+
+int realtime_cpu(void)
+{
+    return configured_cpu;
+}
+
+void realtime_enter(void)
+{
+    if (configured_cpu < 0)
+    {
+        return;
+    }
+
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(configured_cpu, &cpus);
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    if (err != 0)
+    {
+        LOG_WARNING("Could not pin the control loop to CPU %d, err = %d\n", configured_cpu, err);
+    }
+
+    struct sched_param param = {.sched_priority = REALTIME_PRIORITY};
+    err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (err != 0)
+    {
+        LOG_WARNING("SCHED_FIFO not permitted, err = %d\n", err);
+    }
+
+    /* Heap memory is kept instead of returned to the kernel, so later allocations do not fault */
+    (void)mallopt(M_TRIM_THRESHOLD, -1);
+    (void)mallopt(M_MMAP_MAX, 0);
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) == -1)
+    {
+        LOG_WARNING("Could not lock memory, err = %d\n", errno);
+    }
+    prefault_stack();
+    LOG_INFO("Real-time mode on CPU %d\n", configured_cpu);
+}
@@ -0,0 +1,310 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <log.h>
+#include <netinet/ip.h>
+#include <orders.h>
+#include <poll.h>
+#include <pthread.h>
+#include <receiver.h>
+#include <stats.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <trace.h>
+#include <unistd.h>
+
+#define RECEIVER_FRESH (4) // Set in the middle buffer index when it holds a snapshot the control loop has not taken
+
+/* Triple buffer. The receive thread fills the back buffer and swaps it with the middle one, and the control loop swaps
+ * its front buffer with the middle one when that is fresh. Neither side ever waits for the other */
+static peer_snapshot_t buffers[3];
+static atomic_uint middle = 2;
+static unsigned back = 0;
+static unsigned front = 1;
+
+static peer_snapshot_t latest; // Written by the receiving thread only
+static socket_t peer_socket;
+static size_t own_first;
+static size_t own_count;
+static bool threaded;
+static int notify_fd = -1; // Signaled by the receive thread whenever it publishes a snapshot
+static uint32_t state_sequences[ELEVATOR_COUNT]; // Sequence of the newest state received from each elevator
+
+static bool is_local(const size_t i)
+{
+    return i >= own_first && i < own_first + own_count;
+}
+
+static bool is_member(const struct sockaddr_in *addr_in)
+{
+    for (size_t i = 0; i < ELEVATOR_COUNT; ++i)
+    {
+        const gossip_member_t *member = &latest.members[i];
+        if (member->incarnation != 0 && member->address == addr_in->sin_addr.s_addr &&
+            member->port == addr_in->sin_port && !is_local(i))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Merges the member list of a gossip message. The sender speaks for the address of its own elevators, which is
+ * the source address of the message
+ */
+static void merge_gossip(const peer_gossip_t *gossip, const struct sockaddr_in *addr_in)
+{
+    for (size_t i = 0; i < gossip->member_count; ++i)
+    {
+        gossip_member_t member = gossip->members[i];
+        if (member.index >= ELEVATOR_COUNT || is_local(member.index) || member.incarnation == 0)
+        {
+            continue;
+        }
+        if (member.index >= gossip->first_index && member.index < gossip->first_index + gossip->count)
+        {
+            member.address = addr_in->sin_addr.s_addr;
+            member.port = addr_in->sin_port;
+        }
+        gossip_member_t *known = &latest.members[member.index];
+        if (member.incarnation > known->incarnation ||
+            (member.incarnation == known->incarnation && member.heartbeat > known->heartbeat))
+        {
+            *known = member;
+        }
+    }
+}
+
+/**
+ * @brief Merges a hall call or lock claim into the newest state of the elevator that sent it, so the control loop sees
+ * it without waiting for the next periodic state. Merging is idempotent, so retransmissions need no deduplication. An
+ * event that arrives after a newer state of its elevator is dropped, since that state may already have completed the
+ * call
+ */
+static void apply_event(const peer_event_t *event)
+{
+    if (event->state_sequence < state_sequences[event->index])
+    {
+        return;
+    }
+    elevator_t *elevator = &latest.elevators[event->index];
+    elevator->floor_states[event->floor] |= event->floor_state;
+    for (elevator_direction_t direction = ELEVATOR_DIRECTION_UP; direction <= ELEVATOR_DIRECTION_DOWN; ++direction)
+    {
+        if (event->floor_state & direction_to_floor_flag_locked(direction))
+        {
+            elevator->locking_elevator[direction][event->floor] = event->locking_elevator[direction];
+        }
+    }
+    ++latest.state_counts[event->index];
+}
+
+static void acknowledge(const peer_event_t *event, const struct sockaddr_in *addr_in)
+{
+    const peer_ack_t ack = {
+        .type = PEER_MESSAGE_TYPE_ACK, .first_index = own_first, .count = own_count, .sequence = event->sequence};
+    if (trace_sendto(peer_socket, &ack, sizeof(ack), MSG_NOSIGNAL, (const struct sockaddr *)addr_in,
+                     sizeof(*addr_in)) == -1)
+    {
+        LOG_ERROR("ack error = %d\n", errno);
+        return;
+    }
+    stats_datagram_out();
+}
+
+/**
+ * @brief Receives every datagram that is queued on the peer socket into latest
+ *
+ * @return true if any valid datagram was received
+ */
+static bool drain(void)
+{
+    union {
+        uint8_t type;
+        peer_message_t state;
+        zone_digest_t digest;
+        peer_event_t event;
+        peer_ack_t ack;
+        peer_gossip_t gossip;
+        peer_sync_request_t sync_request;
+        peer_sync_t sync;
+    } message;
+    struct sockaddr_in addr_in;
+    socklen_t addr_size = sizeof(addr_in);
+    ssize_t size;
+    bool received = false;
+    while ((size = trace_recvfrom(peer_socket, &message, sizeof(message), MSG_NOSIGNAL | (threaded ? MSG_DONTWAIT : 0),
+                                  (struct sockaddr *)&addr_in, &addr_size)) != -1)
+    {
+        /* Gossip is how unknown nodes join, everything else has to come from a member */
+        if (message.type == PEER_MESSAGE_TYPE_GOSSIP && size >= (ssize_t)offsetof(peer_gossip_t, members) &&
+            message.gossip.member_count <= ELEVATOR_COUNT &&
+            message.gossip.first_index + message.gossip.count <= ELEVATOR_COUNT &&
+            size == (ssize_t)offsetof(peer_gossip_t, members[message.gossip.member_count]))
+        {
+            merge_gossip(&message.gossip, &addr_in);
+            stats_datagram_in();
+            received = true;
+            continue;
+        }
+        const bool found = is_member(&addr_in);
+
+        if (found && message.type == PEER_MESSAGE_TYPE_DIGEST && size == sizeof(zone_digest_t) &&
+            message.digest.index < ELEVATOR_COUNT)
+        {
+            const size_t zone = zone_of(message.digest.index);
+            latest.digests[zone] = message.digest;
+            ++latest.digest_counts[zone];
+            stats_datagram_in();
+            received = true;
+            continue;
+        }
+
+        if (found && message.type == PEER_MESSAGE_TYPE_EVENT && size == sizeof(peer_event_t) &&
+            message.event.index < ELEVATOR_COUNT && message.event.floor < FLOOR_COUNT)
+        {
+            apply_event(&message.event);
+            acknowledge(&message.event, &addr_in);
+            stats_datagram_in();
+            received = true;
+            continue;
+        }
+
+        if (found && message.type == PEER_MESSAGE_TYPE_ACK && size == sizeof(peer_ack_t) &&
+            message.ack.first_index + message.ack.count <= ELEVATOR_COUNT)
+        {
+            for (size_t i = message.ack.first_index; i < (size_t)message.ack.first_index + message.ack.count; ++i)
+            {
+                latest.acks[i][message.ack.sequence % PEER_EVENT_SLOTS] = message.ack.sequence;
+            }
+            stats_datagram_in();
+            received = true;
+            continue;
+        }
+
+        if (found && message.type == PEER_MESSAGE_TYPE_SYNC_REQUEST && size == sizeof(peer_sync_request_t) &&
+            message.sync_request.first_index < ELEVATOR_COUNT)
+        {
+            latest.sync_requests[message.sync_request.first_index] = message.sync_request;
+            latest.sync_sources[message.sync_request.first_index] = addr_in;
+            stats_datagram_in();
+            received = true;
+            continue;
+        }
+
+        if (found && message.type == PEER_MESSAGE_TYPE_SYNC && size == sizeof(peer_sync_t) &&
+            message.sync.first_index < ELEVATOR_COUNT)
+        {
+            latest.sync = message.sync;
+            ++latest.sync_count;
+            stats_datagram_in();
+            received = true;
+            continue;
+        }
+
+        if (!found || message.type != PEER_MESSAGE_TYPE_STATE || size < (ssize_t)offsetof(peer_message_t, elevators) ||
+            message.state.first_index + message.state.count > ELEVATOR_COUNT ||
+            size != (ssize_t)offsetof(peer_message_t, elevators[message.state.count]))
+        {
+            LOG_ERROR("Wrong port or size from recv %d\n", errno);
+            continue;
+        }
+        stats_datagram_in();
+        for (size_t i = 0; i < message.state.count; ++i)
+        {
+            latest.elevators[message.state.first_index + i] = message.state.elevators[i];
+            ++latest.state_counts[message.state.first_index + i];
+            /* Taken as is, not as a maximum, so a restarted process that counts from 1 again is not ignored */
+            state_sequences[message.state.first_index + i] = message.state.sequence;
+        }
+        received = true;
+    }
+    return received;
+}
+
+static void *receive_routine(void *arg)
+{
+    (void)arg;
+    struct pollfd fd = {.fd = peer_socket, .events = POLLIN};
+    while (1)
+    {
+        if (poll(&fd, 1, -1) == -1 && errno != EINTR)
+        {
+            LOG_ERROR("poll failed, err = %d\n", errno);
+            return NULL;
+        }
+        /* A burst of datagrams is published as one snapshot */
+        if (!drain())
+        {
+            continue;
+        }
+        buffers[back] = latest;
+        back = atomic_exchange_explicit(&middle, back | RECEIVER_FRESH, memory_order_acq_rel) & ~RECEIVER_FRESH;
+        (void)eventfd_write(notify_fd, 1);
+    }
+    return NULL;
+}
+
+int receiver_start(socket_t sock, size_t first, size_t count)
+{
+    peer_socket = sock;
+    own_first = first;
+    own_count = count;
+
+    if (trace_is_replaying() || trace_is_recording())
+    {
+        return 0;
+    }
+    notify_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (notify_fd == -1)
+    {
+        LOG_ERROR("eventfd failed, err = %d\n", errno);
+        return -errno;
+    }
+    pthread_t thread;
+    int err = pthread_create(&thread, NULL, receive_routine, NULL);
+    if (err != 0)
+    {
+        LOG_ERROR("Could not start receive thread, err = %d\n", err);
+        (void)close(notify_fd);
+        notify_fd = -1;
+        return -err;
+    }
+    threaded = true;
+    return 0;
+}
+
+const peer_snapshot_t *receiver_snapshot(void)
+{
+    if (!threaded)
+    {
+        (void)drain();
+        return &latest;
+    }
+    if (atomic_load_explicit(&middle, memory_order_relaxed) & RECEIVER_FRESH)
+    {
+        front = atomic_exchange_explicit(&middle, front, memory_order_acq_rel) & ~RECEIVER_FRESH;
+    }
+    return &buffers[front];
+}
+
+bool receiver_wait(int64_t timeout)
+{
+    if (trace_is_replaying())
+    {
+        return false;
+    }
+    /* Without the receive thread, datagrams queued on the peer socket are what a new snapshot is made of */
+    struct pollfd fd = {.fd = threaded ? notify_fd : peer_socket, .events = POLLIN};
+    const struct timespec time = {.tv_sec = timeout / 1000000000LL, .tv_nsec = timeout % 1000000000LL};
+    const int ready = ppoll(&fd, 1, &time, NULL);
+    if (ready == 1 && threaded)
+    {
+        eventfd_t value;
+        (void)eventfd_read(notify_fd, &value);
+    }
+    return ready == 0;
+}
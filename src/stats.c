@@ -0,0 +1,133 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <log.h>
+#include <orders.h>
+#include <stats.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#define STATS_SMOOTHING_SHIFT (4) // Exponential smoothing with weight 1/16 on every new sample
+
+static stats_segment_t private_segment;
+static stats_segment_t *segment = &private_segment;
+static int64_t loop_start_ns;
+
+/* clock_gettime is served by the vDSO, so reading it does not enter the kernel */
+static int64_t monotonic_nsec(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (int64_t)time.tv_sec * 1000000000LL + time.tv_nsec;
+}
+
+static uint32_t smooth(const uint32_t average, const int64_t sample)
+{
+    return average == 0 ? sample : (uint32_t)(average + ((sample - (int64_t)average) >> STATS_SMOOTHING_SHIFT));
+}
+
+int stats_init(size_t index, size_t count)
+{
+    char name[32];
+    (void)snprintf(name, sizeof(name), STATS_NAME_FORMAT, index);
+    /* Readable by everyone, only this process can write it */
+    int fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+    if (fd == -1)
+    {
+        LOG_ERROR("Could not create statistics segment, err = %d\n", errno);
+        return -errno;
+    }
+    if (ftruncate(fd, sizeof(stats_segment_t)) == -1)
+    {
+        int err = -errno;
+        LOG_ERROR("ftruncate failed, err = %d\n", errno);
+        (void)close(fd);
+        return err;
+    }
+    stats_segment_t *mapped = mmap(NULL, sizeof(stats_segment_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    (void)close(fd);
+    if ((void *)mapped == MAP_FAILED)
+    {
+        LOG_ERROR("mmap failed, err = %d\n", errno);
+        return -errno;
+    }
+
+    /* Counters restart with the process, a backup taking over is a new process */
+    *mapped = (stats_segment_t){.version = STATS_VERSION, .pid = getpid(), .first_index = index, .count = count};
+    mapped->magic = STATS_MAGIC;
+    segment = mapped;
+    loop_start_ns = monotonic_nsec();
+    return 0;
+}
+
+void stats_loop_begin(void)
+{
+    loop_start_ns = monotonic_nsec();
+}
+
+void stats_loop(void)
+{
+    const int64_t now = monotonic_nsec();
+    const int64_t duration = loop_start_ns == 0 ? 0 : now - loop_start_ns;
+    loop_start_ns = now;
+
+    segment->loop_ns = smooth(segment->loop_ns, duration);
+    if (duration > segment->loop_max_ns)
+    {
+        segment->loop_max_ns = duration > UINT32_MAX ? UINT32_MAX : duration;
+    }
+    atomic_fetch_add_explicit(&segment->loop_count, 1, memory_order_relaxed);
+    segment->heartbeat_ns = now;
+}
+
+void stats_datagram_in(void)
+{
+    atomic_fetch_add_explicit(&segment->datagrams_in, 1, memory_order_relaxed);
+}
+
+void stats_datagram_out(void)
+{
+    atomic_fetch_add_explicit(&segment->datagrams_out, 1, memory_order_relaxed);
+}
+
+void stats_driver_rtt(size_t index, int64_t rtt_ns)
+{
+    stats_elevator_t *elevator = &segment->elevators[index];
+    elevator->driver_rtt_ns = smooth(elevator->driver_rtt_ns, rtt_ns);
+    if (rtt_ns > elevator->driver_rtt_max_ns)
+    {
+        elevator->driver_rtt_max_ns = rtt_ns > UINT32_MAX ? UINT32_MAX : rtt_ns;
+    }
+}
+
+void stats_wakeup_latency(int64_t latency_ns)
+{
+    segment->wakeup_latency_ns = smooth(segment->wakeup_latency_ns, latency_ns);
+    if (latency_ns > segment->wakeup_latency_max_ns)
+    {
+        segment->wakeup_latency_max_ns = latency_ns > UINT32_MAX ? UINT32_MAX : latency_ns;
+    }
+}
+
+void stats_elevator(size_t index, const elevator_t *elevator, uint8_t connected_peers)
+{
+    uint8_t hall_calls = 0;
+    uint8_t cab_calls = 0;
+    for (size_t i = 0; i < FLOOR_COUNT; ++i)
+    {
+        hall_calls += ((elevator->floor_states[i] & FLOOR_FLAG_BUTTON_UP) != 0) +
+                      ((elevator->floor_states[i] & FLOOR_FLAG_BUTTON_DOWN) != 0);
+        cab_calls += (elevator->floor_states[i] & FLOOR_FLAG_BUTTON_CAB) != 0;
+    }
+
+    stats_elevator_t *stats = &segment->elevators[index];
+    stats->state = elevator->state;
+    stats->current_floor = elevator->current_floor;
+    stats->target_floor = elevator->target_floor;
+    stats->direction = elevator->direction;
+    stats->disabled = elevator->disabled;
+    stats->hall_calls = hall_calls;
+    stats->cab_calls = cab_calls;
+    stats->connected_peers = connected_peers;
+}
@@ -0,0 +1,323 @@
+#include <errno.h>
+#include <log.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <string.h>
+#include <trace.h>
+
+#define TRACE_MAGIC ("ELVT")
+#define TRACE_VERSION (14)
+
+typedef enum
+{
+    TRACE_MODE_OFF = 0,
+    TRACE_MODE_RECORD,
+    TRACE_MODE_REPLAY,
+} trace_mode_t;
+
+typedef struct
+{
+    char magic[4];
+    uint8_t version;
+    uint8_t floor_count;
+    uint8_t elevator_count;
+    uint8_t index;
+    uint8_t count;
+    uint8_t reserved[3];
+    uint32_t elevator_size;
+} trace_file_header_t;
+
+typedef struct
+{
+    uint8_t type;
+    uint8_t reserved;
+    uint16_t size;     // Payload bytes following the header
+    int32_t result;    // Return value of the call, negative error code on failure
+    uint32_t delta_us; // Time since the previous event
+} trace_event_header_t;
+
+static trace_mode_t mode;
+static FILE *file;
+static bool realtime;
+static bool finished;
+static int64_t last_event_ns; // Recording: time of the previous event. Replay: trace time of the previous event
+static int64_t start_ns;
+static uint64_t event_count;
+static uint8_t scratch[UINT16_MAX];
+
+static int64_t monotonic_nsec(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (int64_t)time.tv_sec * 1000000000LL + time.tv_nsec;
+}
+
+int trace_record_open(const char *path, size_t index, size_t count)
+{
+    file = fopen(path, "wb");
+    if (file == NULL)
+    {
+        LOG_ERROR("Could not open trace %s, err = %d\n", path, errno);
+        return -errno;
+    }
+    trace_file_header_t header = {.version = TRACE_VERSION,
+                                  .floor_count = FLOOR_COUNT,
+                                  .elevator_count = ELEVATOR_COUNT,
+                                  .index = index,
+                                  .count = count,
+                                  .elevator_size = sizeof(elevator_t)};
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    if (fwrite(&header, sizeof(header), 1, file) != 1)
+    {
+        LOG_ERROR("Could not write trace header\n");
+        (void)fclose(file);
+        file = NULL;
+        return -EIO;
+    }
+    mode = TRACE_MODE_RECORD;
+    start_ns = last_event_ns = monotonic_nsec();
+    return 0;
+}
+
+int trace_replay_open(const char *path, bool replay_realtime, size_t *index, size_t *count)
+{
+    file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        LOG_ERROR("Could not open trace %s, err = %d\n", path, errno);
+        return -errno;
+    }
+    trace_file_header_t header;
+    if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != TRACE_VERSION)
+    {
+        LOG_ERROR("%s is not a trace\n", path);
+        (void)fclose(file);
+        file = NULL;
+        return -EINVAL;
+    }
+    /* The states in the trace are raw elevator_t, so the trace only replays in a build with the same layout */
+    if (header.floor_count != FLOOR_COUNT || header.elevator_count != ELEVATOR_COUNT ||
+        header.elevator_size != sizeof(elevator_t) || header.count == 0 ||
+        (size_t)header.index + header.count > ELEVATOR_COUNT)
+    {
+        LOG_ERROR("Trace recorded with FLOOR_COUNT = %u and ELEVATOR_COUNT = %u does not match this build\n",
+                  header.floor_count, header.elevator_count);
+        (void)fclose(file);
+        file = NULL;
+        return -EINVAL;
+    }
+    *index = header.index;
+    *count = header.count;
+    mode = TRACE_MODE_REPLAY;
+    realtime = replay_realtime;
+    last_event_ns = 0;
+    start_ns = monotonic_nsec();
+    return 0;
+}
+
+void trace_close(void)
+{
+    if (file == NULL)
+    {
+        return;
+    }
+    if (mode == TRACE_MODE_REPLAY)
+    {
+        const int64_t elapsed_ns = monotonic_nsec() - start_ns;
+        LOG_INFO("Replayed %" PRIu64 " events, %.3f s of trace in %.3f s\n", event_count, last_event_ns / 1e9,
+                 elapsed_ns / 1e9);
+    }
+    (void)fclose(file);
+    file = NULL;
+    mode = TRACE_MODE_OFF;
+}
+
+bool trace_is_replaying(void)
+{
+    return mode == TRACE_MODE_REPLAY;
+}
+
+bool trace_is_recording(void)
+{
+    return mode == TRACE_MODE_RECORD;
+}
+
+bool trace_is_finished(void)
+{
+    return finished;
+}
+
+void trace_record(trace_event_type_t type, const void *data, size_t size, int32_t result)
+{
+    if (mode != TRACE_MODE_RECORD)
+    {
+        return;
+    }
+    const int64_t now = monotonic_nsec();
+    trace_event_header_t header = {
+        .type = type, .size = size, .result = result, .delta_us = (uint32_t)((now - last_event_ns) / 1000)};
+    /* Keep the sub-microsecond remainder, so the replayed timing does not drift */
+    last_event_ns += (int64_t)header.delta_us * 1000;
+    if (fwrite(&header, sizeof(header), 1, file) != 1 || (size > 0 && fwrite(data, size, 1, file) != 1))
+    {
+        LOG_ERROR("Could not write trace, recording stopped\n");
+        (void)fclose(file);
+        file = NULL;
+        mode = TRACE_MODE_OFF;
+        return;
+    }
+    ++event_count;
+}
+
+int32_t trace_replay(trace_event_type_t type, void *data, size_t size)
+{
+    trace_event_header_t header;
+    if (finished || fread(&header, sizeof(header), 1, file) != 1)
+    {
+        finished = true;
+        return -ENODATA;
+    }
+    if (header.type != type)
+    {
+        LOG_ERROR("Replay diverged at event %" PRIu64 ", expected type %d, got %u\n", event_count, type, header.type);
+        finished = true;
+        return -ENODATA;
+    }
+    const size_t copied = header.size < size ? header.size : size;
+    if ((copied > 0 && fread(data, copied, 1, file) != 1) ||
+        (header.size > copied && fseek(file, header.size - copied, SEEK_CUR) != 0))
+    {
+        finished = true;
+        return -ENODATA;
+    }
+
+    last_event_ns += (int64_t)header.delta_us * 1000;
+    if (realtime)
+    {
+        const int64_t due_ns = start_ns + last_event_ns;
+        struct timespec due = {.tv_sec = due_ns / 1000000000LL, .tv_nsec = due_ns % 1000000000LL};
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &due, NULL) == EINTR)
+        {
+        }
+    }
+    ++event_count;
+    return header.result;
+}
+
+void trace_flush(void)
+{
+    if (mode == TRACE_MODE_RECORD && fflush(file) != 0)
+    {
+        LOG_ERROR("Could not flush trace, err = %d\n", errno);
+    }
+}
+
+void trace_state(elevator_t *elevators)
+{
+    if (mode == TRACE_MODE_REPLAY)
+    {
+        (void)trace_replay(TRACE_EVENT_STATE, elevators, ELEVATOR_COUNT * sizeof(elevator_t));
+        return;
+    }
+    trace_record(TRACE_EVENT_STATE, elevators, ELEVATOR_COUNT * sizeof(elevator_t), 0);
+}
+
+ssize_t trace_recv(int sock, void *buffer, size_t size, int flags)
+{
+    if (mode == TRACE_MODE_REPLAY)
+    {
+        const int32_t result = trace_replay(TRACE_EVENT_DRIVER, buffer, size);
+        if (result < 0)
+        {
+            errno = -result;
+            return -1;
+        }
+        return result;
+    }
+    ssize_t result = recv(sock, buffer, size, flags);
+    const int err = errno;
+    trace_record(TRACE_EVENT_DRIVER, buffer, result > 0 ? result : 0, result == -1 ? -err : result);
+    errno = err;
+    return result;
+}
+
+ssize_t trace_send(int sock, const void *buffer, size_t size, int flags)
+{
+    if (mode == TRACE_MODE_REPLAY)
+    {
+        return size;
+    }
+    return send(sock, buffer, size, flags);
+}
+
+ssize_t trace_recvfrom(int sock, void *buffer, size_t size, int flags, struct sockaddr *address,
+                       socklen_t *address_size)
+{
+    /* Events hold the source address and port followed by the datagram, since peers are told apart by both */
+    const size_t header_size = sizeof(in_addr_t) + sizeof(in_port_t);
+    if (mode == TRACE_MODE_REPLAY)
+    {
+        const int32_t result = trace_replay(TRACE_EVENT_DATAGRAM, scratch, sizeof(scratch));
+        if (result < 0)
+        {
+            errno = -result;
+            return -1;
+        }
+        struct sockaddr_in *address_in = (struct sockaddr_in *)address;
+        memset(address_in, 0, sizeof(*address_in));
+        address_in->sin_family = AF_INET;
+        memcpy(&address_in->sin_addr.s_addr, scratch, sizeof(in_addr_t));
+        memcpy(&address_in->sin_port, scratch + sizeof(in_addr_t), sizeof(in_port_t));
+        *address_size = sizeof(*address_in);
+        const size_t copied = (size_t)result < size ? (size_t)result : size;
+        memcpy(buffer, scratch + header_size, copied);
+        return copied;
+    }
+    ssize_t result = recvfrom(sock, buffer, size, flags, address, address_size);
+    const int err = errno;
+    if (mode == TRACE_MODE_RECORD)
+    {
+        const struct sockaddr_in *address_in = (const struct sockaddr_in *)address;
+        size_t recorded = header_size;
+        if (result >= 0)
+        {
+            memcpy(scratch, &address_in->sin_addr.s_addr, sizeof(in_addr_t));
+            memcpy(scratch + sizeof(in_addr_t), &address_in->sin_port, sizeof(in_port_t));
+            recorded += (size_t)result < sizeof(scratch) - recorded ? (size_t)result : sizeof(scratch) - recorded;
+            memcpy(scratch + header_size, buffer, recorded - header_size);
+        }
+        trace_record(TRACE_EVENT_DATAGRAM, scratch, result >= 0 ? recorded : 0, result == -1 ? -err : result);
+    }
+    errno = err;
+    return result;
+}
+
+ssize_t trace_sendto(int sock, const void *buffer, size_t size, int flags, const struct sockaddr *address,
+                     socklen_t address_size)
+{
+    if (mode == TRACE_MODE_REPLAY)
+    {
+        return size;
+    }
+    return sendto(sock, buffer, size, flags, address, address_size);
+}
+
+int trace_clock_gettime(clockid_t clock, struct timespec *time)
+{
+    if (mode == TRACE_MODE_REPLAY)
+    {
+        const int32_t result = trace_replay(TRACE_EVENT_CLOCK, time, sizeof(*time));
+        if (result < 0)
+        {
+            errno = -result;
+            return -1;
+        }
+        return 0;
+    }
+    int result = clock_gettime(clock, time);
+    const int err = errno;
+    trace_record(TRACE_EVENT_CLOCK, time, sizeof(*time), result == -1 ? -err : 0);
+    errno = err;
+    return result;
+}
@@ -0,0 +1,194 @@
+#include <orders.h>
+#include <stdbool.h>
+#include <string.h>
+#include <trace.h>
+#include <travel.h>
+
+#define TRAVEL_DEFAULT_FLOOR_MS (2500)
+#define TRAVEL_DEFAULT_DOOR_MS (3500)
+#define TRAVEL_SMOOTHING_SHIFT (3) // Exponential smoothing with weight 1/8 on every new sample
+#define TRAVEL_OUTLIER_FACTOR (4)  // Samples this many times the estimate are stops or obstructions, not travel
+#define TRAVEL_OUTLIER_RUN (3)     // Outliers in a row that show the estimate itself is wrong
+
+static int64_t elapsed_ms(const struct timespec *from, const struct timespec *to)
+{
+    return (to->tv_sec - from->tv_sec) * 1000 + (to->tv_nsec - from->tv_nsec) / 1000000;
+}
+
+/**
+ * @brief Smooths @p sample into @p estimate. A sample far above the estimate is discarded, unless it is the last of
+ * TRAVEL_OUTLIER_RUN in a row, in which case the estimate starts over from the smallest of them, so a car that really
+ * is that slow is learned instead of ignored forever
+ */
+static void learn(uint16_t *estimate, travel_outliers_t *outliers, const int64_t sample)
+{
+    if (sample <= 0)
+    {
+        return;
+    }
+    if (sample <= (int64_t)*estimate * TRAVEL_OUTLIER_FACTOR)
+    {
+        outliers->count = 0;
+        *estimate = (uint16_t)(*estimate + ((sample - (int64_t)*estimate) >> TRAVEL_SMOOTHING_SHIFT));
+        return;
+    }
+    const uint16_t time = sample < UINT16_MAX ? (uint16_t)sample : UINT16_MAX;
+    outliers->least = outliers->count == 0 || time < outliers->least ? time : outliers->least;
+    if (++outliers->count == TRAVEL_OUTLIER_RUN)
+    {
+        *estimate = outliers->least;
+        outliers->count = 0;
+    }
+}
+
+static bool is_pending_stop(const elevator_t *elevator, const size_t floor, const size_t index)
+{
+    return (elevator->floor_states[floor] & FLOOR_FLAG_BUTTON_CAB) ||
+           ((elevator->floor_states[floor] & FLOOR_FLAG_LOCKED_UP) &&
+            elevator->locking_elevator[ELEVATOR_DIRECTION_UP][floor] == index) ||
+           ((elevator->floor_states[floor] & FLOOR_FLAG_LOCKED_DOWN) &&
+            elevator->locking_elevator[ELEVATOR_DIRECTION_DOWN][floor] == index);
+}
+
+static uint16_t saturate(const uint32_t time)
+{
+    return time >= TRAVEL_ETA_NONE ? TRAVEL_ETA_NONE - 1 : time;
+}
+
+static void update_eta(const travel_tracker_t *tracker, elevator_t *elevator, const struct timespec *now,
+                       const size_t index)
+{
+    uint32_t time = 0;
+    if (elevator->state == ELEVATOR_STATE_OPEN)
+    {
+        int64_t open = elapsed_ms(&tracker->door_start, now);
+        time = open < elevator->door_time_ms ? elevator->door_time_ms - open : 0;
+    }
+
+    for (size_t j = 0; j < FLOOR_COUNT; ++j)
+    {
+        elevator->eta_ms[j] = TRAVEL_ETA_NONE;
+    }
+
+    /* Serve the stops in the direction of travel first, then sweep back */
+    int position = elevator->current_floor;
+    for (int sweep = 0; sweep < 2; ++sweep)
+    {
+        const int step = (elevator->direction == ELEVATOR_DIRECTION_UP) == (sweep == 0) ? 1 : -1;
+        for (int j = elevator->current_floor; j >= 0 && j < FLOOR_COUNT; j += step)
+        {
+            if (elevator->eta_ms[j] != TRAVEL_ETA_NONE || !is_pending_stop(elevator, j, index))
+            {
+                continue;
+            }
+            time += (uint32_t)(j > position ? j - position : position - j) * elevator->travel_time_ms;
+            elevator->eta_ms[j] = saturate(time);
+            time += elevator->door_time_ms;
+            position = j;
+        }
+    }
+}
+
+void travel_init(travel_tracker_t *tracker, elevator_t *elevator)
+{
+    memset(tracker, 0, sizeof(*tracker));
+    tracker->segment_floor = -1;
+    tracker->floor_signal = -1;
+    tracker->state = elevator->state;
+    if (elevator->travel_time_ms == 0)
+    {
+        elevator->travel_time_ms = TRAVEL_DEFAULT_FLOOR_MS;
+    }
+    if (elevator->door_time_ms == 0)
+    {
+        elevator->door_time_ms = TRAVEL_DEFAULT_DOOR_MS;
+    }
+}
+
+void travel_observe(travel_tracker_t *tracker, elevator_t *elevator, const int floor_signal, const size_t index)
+{
+    struct timespec now;
+    trace_clock_gettime(CLOCK_MONOTONIC, &now);
+
+    /* Departure from standstill starts a segment at the current floor */
+    if (elevator->state == ELEVATOR_STATE_MOVING && tracker->state != ELEVATOR_STATE_MOVING)
+    {
+        tracker->segment_start = now;
+        tracker->segment_floor = elevator->current_floor;
+    }
+
+    /* Arrival at a neighbouring floor ends a floor-to-floor segment, and starts the next one */
+    if (elevator->state == ELEVATOR_STATE_MOVING && floor_signal >= 0 && floor_signal != tracker->floor_signal)
+    {
+        if (tracker->segment_floor >= 0 &&
+            (floor_signal == tracker->segment_floor + 1 || floor_signal == tracker->segment_floor - 1))
+        {
+            learn(&elevator->travel_time_ms, &tracker->floor_outliers, elapsed_ms(&tracker->segment_start, &now));
+        }
+        tracker->segment_start = now;
+        tracker->segment_floor = floor_signal;
+    }
+
+    /* Door cycles */
+    if (elevator->state == ELEVATOR_STATE_OPEN && tracker->state != ELEVATOR_STATE_OPEN)
+    {
+        tracker->door_start = now;
+    }
+    else if (elevator->state != ELEVATOR_STATE_OPEN && tracker->state == ELEVATOR_STATE_OPEN)
+    {
+        learn(&elevator->door_time_ms, &tracker->door_outliers, elapsed_ms(&tracker->door_start, &now));
+    }
+
+    if (elevator->state != ELEVATOR_STATE_MOVING)
+    {
+        tracker->segment_floor = -1;
+    }
+    tracker->state = elevator->state;
+    tracker->floor_signal = floor_signal;
+
+    update_eta(tracker, elevator, &now, index);
+}
+
+uint32_t travel_estimate(const elevator_t *elevator, const uint8_t floor, const elevator_direction_t direction)
+{
+    const uint32_t distance = floor > elevator->current_floor ? floor - elevator->current_floor
+                                                              : elevator->current_floor - floor;
+    const bool ahead = direction == elevator->direction && (elevator->direction == ELEVATOR_DIRECTION_UP
+                                                                ? floor >= elevator->current_floor
+                                                                : floor <= elevator->current_floor);
+
+    /* Find the last pending stop, where the elevator will be free */
+    uint32_t last_eta = 0;
+    int last_floor = -1;
+    uint32_t stops_before = 0;
+    for (size_t j = 0; j < FLOOR_COUNT; ++j)
+    {
+        if (elevator->eta_ms[j] == TRAVEL_ETA_NONE)
+        {
+            continue;
+        }
+        if (last_floor < 0 || elevator->eta_ms[j] > last_eta)
+        {
+            last_eta = elevator->eta_ms[j];
+            last_floor = j;
+        }
+        if (ahead && (elevator->direction == ELEVATOR_DIRECTION_UP ? j < floor : j > floor) &&
+            (elevator->direction == ELEVATOR_DIRECTION_UP ? j >= elevator->current_floor
+                                                          : j <= elevator->current_floor))
+        {
+            ++stops_before;
+        }
+    }
+
+    if (last_floor < 0 || elevator->state == ELEVATOR_STATE_IDLE)
+    {
+        return distance * elevator->travel_time_ms;
+    }
+    /* On the way, the new stop only waits for the stops before it */
+    if (ahead)
+    {
+        return distance * elevator->travel_time_ms + stops_before * elevator->door_time_ms;
+    }
+    const uint32_t back = floor > last_floor ? floor - last_floor : last_floor - floor;
+    return last_eta + elevator->door_time_ms + back * elevator->travel_time_ms;
+}
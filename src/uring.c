@@ -0,0 +1,377 @@
+#include <errno.h>
+#include <uring.h>
+
+#ifndef USE_IO_URING
+
+int uring_init(void)
+{
+    return -ENOSYS;
+}
+
+bool uring_is_enabled(void)
+{
+    return false;
+}
+
+int uring_exchange(int sock, const void *prefix, size_t prefix_size, void *packets, size_t packet_size, size_t count,
+                   int timeout)
+{
+    (void)sock;
+    (void)prefix;
+    (void)prefix_size;
+    (void)packets;
+    (void)packet_size;
+    (void)count;
+    (void)timeout;
+    return -ENOSYS;
+}
+
+ssize_t uring_sendto(int sock, const void *buffer, size_t size, const struct sockaddr_in *address)
+{
+    (void)sock;
+    (void)buffer;
+    (void)size;
+    (void)address;
+    return -ENOSYS;
+}
+
+void uring_submit(void)
+{
+}
+
+#else
+
+#include <linux/io_uring.h>
+#include <log.h>
+#include <peer_message.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define URING_SEND_SLOTS (32)
+#define URING_ENTRIES (3 * URING_EXCHANGE_MAX + 1 + URING_SEND_SLOTS)
+#define URING_TAG_EXCHANGE (URING_SEND_SLOTS) // Send slots are tagged with their index
+#define URING_TAG_PREFIX (URING_SEND_SLOTS + 1)
+#define URING_TAG_TIMEOUT (URING_SEND_SLOTS + 2)
+
+typedef struct
+{
+    bool busy; // Until its completion has been reaped
+    struct msghdr message;
+    struct iovec iov;
+    struct sockaddr_in address;
+    uint8_t data[sizeof(peer_message_t)];
+} uring_send_slot_t;
+
+typedef struct
+{
+    unsigned done; // Completions reaped
+    int err;       // First error of the chain
+    size_t size;   // Bytes every request and reply of the chain transfers
+    size_t prefix_size;
+} exchange_state_t;
+
+static int ring_fd = -1;
+static unsigned entries;
+static atomic_uint *sq_head;
+static atomic_uint *sq_tail;
+static unsigned *sq_mask;
+static unsigned *sq_array;
+static struct io_uring_sqe *sqes;
+static atomic_uint *cq_head;
+static atomic_uint *cq_tail;
+static unsigned *cq_mask;
+static struct io_uring_cqe *cqes;
+static unsigned queued; // Entries written since the last submission
+static uring_send_slot_t send_slots[URING_SEND_SLOTS];
+
+static int enter(unsigned to_submit, unsigned min_complete)
+{
+    int result;
+    do
+    {
+        result = syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete,
+                         min_complete > 0 ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    } while (result == -1 && errno == EINTR);
+    return result == -1 ? -errno : result;
+}
+
+static unsigned free_entries(void)
+{
+    return entries - (atomic_load_explicit(sq_tail, memory_order_relaxed) -
+                      atomic_load_explicit(sq_head, memory_order_acquire));
+}
+
+static struct io_uring_sqe *get_sqe(void)
+{
+    unsigned tail = atomic_load_explicit(sq_tail, memory_order_relaxed);
+    if (tail - atomic_load_explicit(sq_head, memory_order_acquire) >= entries)
+    {
+        if (enter(queued, 0) < 0)
+        {
+            return NULL;
+        }
+        queued = 0;
+        if (tail - atomic_load_explicit(sq_head, memory_order_acquire) >= entries)
+        {
+            return NULL;
+        }
+    }
+    struct io_uring_sqe *sqe = &sqes[tail & *sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    sq_array[tail & *sq_mask] = tail & *sq_mask;
+    atomic_store_explicit(sq_tail, tail + 1, memory_order_release);
+    ++queued;
+    return sqe;
+}
+
+/**
+ * @brief Reaps all completions. Completed datagrams free their slot
+ *
+ * @param exchange exchange in progress, or NULL
+ */
+static void reap(exchange_state_t *exchange)
+{
+    unsigned head = atomic_load_explicit(cq_head, memory_order_relaxed);
+    while (head != atomic_load_explicit(cq_tail, memory_order_acquire))
+    {
+        const struct io_uring_cqe *cqe = &cqes[head & *cq_mask];
+        if (cqe->user_data < URING_SEND_SLOTS)
+        {
+            send_slots[cqe->user_data].busy = false;
+            if (cqe->res < 0)
+            {
+                LOG_ERROR("broadcast error = %d\n", -cqe->res);
+            }
+        }
+        else if (exchange != NULL && cqe->user_data == URING_TAG_TIMEOUT)
+        {
+            /* A reply that timed out completes with -ECANCELED, and so does the timeout of a reply that arrived */
+            if (cqe->res == -ETIME && exchange->err == 0)
+            {
+                exchange->err = -ETIMEDOUT;
+            }
+            ++exchange->done;
+        }
+        else if (exchange != NULL)
+        {
+            /* The rest of a chain is cancelled after the first failure, and a short transfer is a failure too */
+            const size_t size = cqe->user_data == URING_TAG_PREFIX ? exchange->prefix_size : exchange->size;
+            if (exchange->err == 0 && cqe->res != (int32_t)size)
+            {
+                exchange->err = cqe->res < 0 ? cqe->res : -ECONNRESET;
+            }
+            ++exchange->done;
+        }
+        ++head;
+    }
+    atomic_store_explicit(cq_head, head, memory_order_release);
+}
+
+int uring_init(void)
+{
+    struct io_uring_params params = {0};
+    int fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &params);
+    if (fd == -1)
+    {
+        return -errno;
+    }
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP))
+    {
+        (void)close(fd);
+        return -ENOTSUP;
+    }
+
+    size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    size_t ring_size = sq_size > cq_size ? sq_size : cq_size;
+    uint8_t *ring = mmap(NULL, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if ((void *)ring == MAP_FAILED)
+    {
+        int err = -errno;
+        (void)close(fd);
+        return err;
+    }
+    sqes = mmap(NULL, params.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if ((void *)sqes == MAP_FAILED)
+    {
+        int err = -errno;
+        (void)munmap(ring, ring_size);
+        (void)close(fd);
+        return err;
+    }
+
+    sq_head = (atomic_uint *)(ring + params.sq_off.head);
+    sq_tail = (atomic_uint *)(ring + params.sq_off.tail);
+    sq_mask = (unsigned *)(ring + params.sq_off.ring_mask);
+    sq_array = (unsigned *)(ring + params.sq_off.array);
+    cq_head = (atomic_uint *)(ring + params.cq_off.head);
+    cq_tail = (atomic_uint *)(ring + params.cq_off.tail);
+    cq_mask = (unsigned *)(ring + params.cq_off.ring_mask);
+    cqes = (struct io_uring_cqe *)(ring + params.cq_off.cqes);
+    entries = params.sq_entries;
+    ring_fd = fd;
+    return 0;
+}
+
+bool uring_is_enabled(void)
+{
+    return ring_fd != -1;
+}
+
+static void prep_stream(struct io_uring_sqe *sqe, uint8_t opcode, int sock, void *buffer, size_t size, uint64_t tag)
+{
+    sqe->opcode = opcode;
+    sqe->fd = sock;
+    sqe->addr = (uintptr_t)buffer;
+    sqe->len = size;
+    sqe->msg_flags = opcode == IORING_OP_RECV ? MSG_WAITALL : MSG_NOSIGNAL;
+    sqe->flags = IOSQE_IO_LINK;
+    sqe->user_data = tag;
+}
+
+static int abort_chain(unsigned tail, unsigned queued_before)
+{
+    atomic_store_explicit(sq_tail, tail, memory_order_release);
+    queued = queued_before;
+    return -EBUSY;
+}
+
+int uring_exchange(int sock, const void *prefix, size_t prefix_size, void *packets, size_t packet_size, size_t count,
+                   int timeout)
+{
+    if (count > URING_EXCHANGE_MAX)
+    {
+        return -EINVAL;
+    }
+    /* A chain must not be split over two submissions, so queued datagrams are submitted first if it does not fit */
+    const unsigned needed = 3 * count + (prefix_size > 0);
+    if (free_entries() < needed)
+    {
+        uring_submit();
+    }
+    if (free_entries() < needed)
+    {
+        return -EBUSY;
+    }
+    /* Entries taken for a chain that cannot be completed are given back, so no partial chain is ever submitted */
+    const unsigned chain_tail = atomic_load_explicit(sq_tail, memory_order_relaxed);
+    const unsigned chain_queued = queued;
+
+    /* Every entry is linked to the next one, so each request is only written once the previous reply is read. Each
+     * read is bounded by a linked timeout, which the chain continues after */
+    const struct __kernel_timespec reply_timeout = {.tv_sec = timeout / 1000, .tv_nsec = (timeout % 1000) * 1000000LL};
+    struct io_uring_sqe *sqe = NULL;
+    if (prefix_size > 0)
+    {
+        if ((sqe = get_sqe()) == NULL)
+        {
+            return abort_chain(chain_tail, chain_queued);
+        }
+        prep_stream(sqe, IORING_OP_SEND, sock, (void *)prefix, prefix_size, URING_TAG_PREFIX);
+    }
+    for (size_t i = 0; i < count; ++i)
+    {
+        uint8_t *packet = (uint8_t *)packets + i * packet_size;
+        if ((sqe = get_sqe()) == NULL)
+        {
+            return abort_chain(chain_tail, chain_queued);
+        }
+        prep_stream(sqe, IORING_OP_SEND, sock, packet, packet_size, URING_TAG_EXCHANGE);
+        if ((sqe = get_sqe()) == NULL)
+        {
+            return abort_chain(chain_tail, chain_queued);
+        }
+        prep_stream(sqe, IORING_OP_RECV, sock, packet, packet_size, URING_TAG_EXCHANGE);
+        if ((sqe = get_sqe()) == NULL)
+        {
+            return abort_chain(chain_tail, chain_queued);
+        }
+        sqe->opcode = IORING_OP_LINK_TIMEOUT;
+        sqe->fd = -1;
+        sqe->addr = (uintptr_t)&reply_timeout;
+        sqe->len = 1;
+        sqe->flags = IOSQE_IO_LINK;
+        sqe->user_data = URING_TAG_TIMEOUT;
+    }
+    sqe->flags &= ~IOSQE_IO_LINK;
+
+    exchange_state_t exchange = {.size = packet_size, .prefix_size = prefix_size};
+    int err = enter(queued, needed);
+    queued = 0;
+    while (err >= 0)
+    {
+        reap(&exchange);
+        if (exchange.done == needed)
+        {
+            break;
+        }
+        err = enter(0, needed - exchange.done);
+    }
+    if (err < 0)
+    {
+        return err;
+    }
+    return exchange.err;
+}
+
+ssize_t uring_sendto(int sock, const void *buffer, size_t size, const struct sockaddr_in *address)
+{
+    if (size > sizeof(send_slots[0].data))
+    {
+        return -EMSGSIZE;
+    }
+    reap(NULL);
+    size_t i = 0;
+    while (i < URING_SEND_SLOTS && send_slots[i].busy)
+    {
+        ++i;
+    }
+    if (i == URING_SEND_SLOTS)
+    {
+        return -ENOBUFS;
+    }
+    struct io_uring_sqe *sqe = get_sqe();
+    if (sqe == NULL)
+    {
+        return -EBUSY;
+    }
+
+    uring_send_slot_t *slot = &send_slots[i];
+    memcpy(slot->data, buffer, size);
+    slot->address = *address;
+    slot->iov = (struct iovec){.iov_base = slot->data, .iov_len = size};
+    slot->message = (struct msghdr){
+        .msg_name = &slot->address, .msg_namelen = sizeof(slot->address), .msg_iov = &slot->iov, .msg_iovlen = 1};
+    slot->busy = true;
+
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = sock;
+    sqe->addr = (uintptr_t)&slot->message;
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = i;
+    return size;
+}
+
+void uring_submit(void)
+{
+    if (queued == 0)
+    {
+        return;
+    }
+    int err = enter(queued, 0);
+    if (err < 0)
+    {
+        LOG_ERROR("io_uring_enter failed, err = %d\n", -err);
+        return;
+    }
+    queued = 0;
+}
+
+#endif
@@ -0,0 +1,792 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <math.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mount.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LOAD_HARDWARE_PORT (15657)
+#define LOAD_FLOOR_TIME_NSEC (2000000000LL) // Travel time between two floors
+#define LOAD_SENSOR_WIDTH (0.1)             // Distance from a floor, in floors, at which its sensor is active
+#define LOAD_WARMUP_NSEC (4000000000LL)     // Time for the nodes to connect, home and join before passengers arrive
+#define LOAD_MAX_PASSENGERS (65536)
+#define LOAD_POLL_TIMEOUT_MS (1)
+
+typedef enum
+{
+    HARDWARE_COMMAND_RELOAD = 0,
+    HARDWARE_COMMAND_MOTOR = 1,
+    HARDWARE_COMMAND_BUTTON_LAMP = 2,
+    HARDWARE_COMMAND_FLOOR_INDICATOR = 3,
+    HARDWARE_COMMAND_DOOR_LAMP = 4,
+    HARDWARE_COMMAND_STOP_LAMP = 5,
+    HARDWARE_COMMAND_ORDER_BUTTON = 6,
+    HARDWARE_COMMAND_FLOOR_SENSOR = 7,
+    HARDWARE_COMMAND_STOP_BUTTON = 8,
+    HARDWARE_COMMAND_OBSTRUCTION = 9,
+} hardware_command_t;
+
+typedef struct
+{
+    int64_t arrival;   // Time the passenger starts waiting, relative to the start of the workload
+    int64_t boarded;   // Monotonic time the passenger entered a car, 0 while waiting
+    int64_t delivered; // Monotonic time the passenger left the car at the destination, 0 before
+    uint8_t from;
+    uint8_t to;
+    uint8_t panel; // Node whose hall panel the passenger presses
+    int8_t car;    // Car the passenger rides in, -1 while waiting
+} passenger_t;
+
+/**
+ * @brief Hardware stand-in and process of one node
+ */
+typedef struct
+{
+    int listen_fd;
+    int client_fd;
+    uint8_t packet[4];
+    size_t received;
+    double position; // Car position in floors
+    int8_t motor;
+    bool door;
+    pid_t pid;
+    uint64_t cpu_ticks;
+    uint64_t wire_tx;
+    uint64_t wire_rx;
+} load_node_t;
+
+static load_node_t nodes[ELEVATOR_COUNT];
+static size_t node_count = 3;
+static passenger_t *passengers;
+static size_t passenger_count;
+static volatile sig_atomic_t interrupted;
+
+static int64_t monotonic_nsec(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (int64_t)time.tv_sec * 1000000000LL + time.tv_nsec;
+}
+
+static void on_interrupt(int signal)
+{
+    (void)signal;
+    interrupted = 1;
+}
+
+/**
+ * @brief Draws the next number of a xorshift64* sequence, so a seed always gives the same workload
+ *
+ * @param state generator state, nonzero
+ * @return uniformly distributed number in [0, 1)
+ */
+static double next_random(uint64_t *state)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return (double)((*state * 0x2545F4914F6CDD1DULL) >> 11) / (double)(1ULL << 53);
+}
+
+/**
+ * @brief Generates Poisson arrivals between random pairs of floors
+ *
+ * @param rate mean arrivals per minute
+ * @param duration length of the workload in nanoseconds
+ * @param seed seed of the generator
+ */
+static void generate_passengers(double rate, int64_t duration, uint64_t seed)
+{
+    uint64_t state = seed != 0 ? seed : 1;
+    double time = 0;
+    while (passenger_count < LOAD_MAX_PASSENGERS)
+    {
+        time += -log(1.0 - next_random(&state)) * 60e9 / rate;
+        if (time >= duration)
+        {
+            break;
+        }
+        passenger_t *passenger = &passengers[passenger_count++];
+        passenger->arrival = (int64_t)time;
+        passenger->from = (uint8_t)(next_random(&state) * FLOOR_COUNT);
+        passenger->to = (uint8_t)((passenger->from + 1 + (size_t)(next_random(&state) * (FLOOR_COUNT - 1))) %
+                                  FLOOR_COUNT);
+        passenger->panel = (uint8_t)(next_random(&state) * node_count);
+        passenger->car = -1;
+    }
+}
+
+/**
+ * @brief Reads a scripted workload with one passenger per line: arrival time in ms, origin floor, destination floor
+ * and optionally the node whose hall panel is pressed. Lines starting with # are skipped
+ *
+ * @param path path of the script
+ * @return error code
+ * @retval 0 on success, otherwise negative error code
+ */
+static int read_script(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+    {
+        return -errno;
+    }
+    char line[128];
+    size_t number = 0;
+    while (fgets(line, sizeof(line), file) != NULL && passenger_count < LOAD_MAX_PASSENGERS)
+    {
+        ++number;
+        if (line[0] == '#' || line[strspn(line, " \t\r\n")] == '\0')
+        {
+            continue;
+        }
+        uint64_t time;
+        unsigned from;
+        unsigned to;
+        unsigned panel = passenger_count % node_count;
+        if (sscanf(line, "%" SCNu64 " %u %u %u", &time, &from, &to, &panel) < 3 || from >= FLOOR_COUNT ||
+            to >= FLOOR_COUNT || from == to || panel >= node_count)
+        {
+            fprintf(stderr, "%s:%zu: invalid passenger\n", path, number);
+            (void)fclose(file);
+            return -EINVAL;
+        }
+        passengers[passenger_count++] = (passenger_t){
+            .arrival = (int64_t)time * 1000000LL, .from = from, .to = to, .panel = panel, .car = -1};
+    }
+    (void)fclose(file);
+    return 0;
+}
+
+/**
+ * @brief Opens the hardware stand-in of node @p i, inside the network namespace of the node if there is one
+ *
+ * @param i node index
+ * @param netns path prefix of the network namespaces, or NULL to use the current one
+ * @return error code
+ * @retval 0 on success, otherwise negative error code
+ */
+static int open_hardware(size_t i, const char *netns)
+{
+    int own_netns = -1;
+    if (netns != NULL)
+    {
+        char path[PATH_MAX];
+        (void)snprintf(path, sizeof(path), "%s%zu", netns, i);
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        own_netns = open("/proc/self/ns/net", O_RDONLY | O_CLOEXEC);
+        if (fd == -1 || own_netns == -1 || setns(fd, CLONE_NEWNET) == -1)
+        {
+            int err = errno;
+            fprintf(stderr, "Could not enter %s, err = %d\n", path, err);
+            (void)close(fd);
+            (void)close(own_netns);
+            return -err;
+        }
+        (void)close(fd);
+    }
+
+    /* The socket stays in the namespace it was created in */
+    int result = 0;
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int reuse = 1;
+    struct sockaddr_in address = {.sin_family = AF_INET,
+                                  .sin_port = htons(LOAD_HARDWARE_PORT + i),
+                                  .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    if (fd == -1 || setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) == -1 ||
+        bind(fd, (struct sockaddr *)&address, sizeof(address)) == -1 || listen(fd, 1) == -1)
+    {
+        result = -errno;
+        fprintf(stderr, "Could not listen on port %zu, err = %d\n", LOAD_HARDWARE_PORT + i, errno);
+        (void)close(fd);
+        fd = -1;
+    }
+    nodes[i].listen_fd = fd;
+    nodes[i].client_fd = -1;
+
+    if (own_netns != -1)
+    {
+        if (setns(own_netns, CLONE_NEWNET) == -1)
+        {
+            fprintf(stderr, "Could not return to the own namespace, err = %d\n", errno);
+            result = -errno;
+        }
+        (void)close(own_netns);
+    }
+    return result;
+}
+
+/**
+ * @brief Starts the elevator process of node @p i. In a namespace setup it runs in the network namespace of the
+ * node, and gets a private /dev/shm so that the nodes do not find each other's shared memory rings
+ *
+ * @param i node index
+ * @param binary absolute path of the elevator executable
+ * @param netns path prefix of the network namespaces, or NULL to use the current one
+ * @param directory directory holding the working directories of the nodes
+ * @param log whether the output of the node is written to elevator.log in its working directory, or discarded
+ * @return error code
+ * @retval 0 on success, otherwise negative error code
+ */
+static int start_node(size_t i, const char *binary, const char *netns, const char *directory, bool log)
+{
+    char path[PATH_MAX];
+    (void)snprintf(path, sizeof(path), "%s/%zu", directory, i);
+    if (mkdir(path, 0755) == -1 && errno != EEXIST)
+    {
+        fprintf(stderr, "Could not create %s, err = %d\n", path, errno);
+        return -errno;
+    }
+
+    pid_t pid = fork();
+    if (pid == -1)
+    {
+        return -errno;
+    }
+    if (pid > 0)
+    {
+        nodes[i].pid = pid;
+        return 0;
+    }
+
+    /* The node and the processes it starts are killed together with the load generator */
+    (void)setpgid(0, 0);
+    (void)prctl(PR_SET_PDEATHSIG, SIGKILL);
+    if (netns != NULL)
+    {
+        char ns_path[PATH_MAX];
+        (void)snprintf(ns_path, sizeof(ns_path), "%s%zu", netns, i);
+        int fd = open(ns_path, O_RDONLY);
+        if (fd == -1 || setns(fd, CLONE_NEWNET) == -1)
+        {
+            fprintf(stderr, "Could not enter %s, err = %d\n", ns_path, errno);
+            _exit(EXIT_FAILURE);
+        }
+        (void)close(fd);
+        if (unshare(CLONE_NEWNS) == -1 || mount(NULL, "/", NULL, MS_REC | MS_PRIVATE, NULL) == -1 ||
+            mount("tmpfs", "/dev/shm", "tmpfs", MS_NOSUID | MS_NODEV, NULL) == -1)
+        {
+            fprintf(stderr, "Node %zu shares /dev/shm with the other nodes, err = %d\n", i, errno);
+        }
+    }
+
+    /* The node must not inherit a socket as stdin, it would take fd 0 for the peer socket it left in shared memory */
+    int input = open("/dev/null", O_RDONLY);
+    int output;
+    if (chdir(path) == -1 || input == -1 ||
+        (output = open(log ? "elevator.log" : "/dev/null", O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1 ||
+        dup2(input, STDIN_FILENO) == -1 || dup2(output, STDOUT_FILENO) == -1 || dup2(output, STDERR_FILENO) == -1)
+    {
+        fprintf(stderr, "Could not prepare %s, err = %d\n", path, errno);
+        _exit(EXIT_FAILURE);
+    }
+    (void)close(input);
+    (void)close(output);
+
+    char index[16];
+    (void)snprintf(index, sizeof(index), "%zu", i);
+    execl(binary, binary, "-i", index, (char *)NULL);
+    fprintf(stderr, "Could not start %s, err = %d\n", binary, errno);
+    _exit(EXIT_FAILURE);
+}
+
+static uint64_t read_cpu_ticks(pid_t pid)
+{
+    char path[64];
+    char line[1024];
+    (void)snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+    {
+        return 0;
+    }
+    char *end = fgets(line, sizeof(line), file);
+    (void)fclose(file);
+    /* The command name may contain spaces, the fields are counted from its closing parenthesis */
+    end = end != NULL ? strrchr(line, ')') : NULL;
+    unsigned long user = 0;
+    unsigned long system = 0;
+    if (end == NULL || sscanf(end + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &user, &system) != 2)
+    {
+        return 0;
+    }
+    return user + system;
+}
+
+/**
+ * @brief Reads the byte counters of the bridge side of the veth pair of every node
+ *
+ * @param prefix interface name prefix, the node index is appended
+ * @param tx bytes sent by each node, array with length equal to ELEVATOR_COUNT
+ * @param rx bytes received by each node, array with length equal to ELEVATOR_COUNT
+ * @return true if the interface of every node was found
+ */
+static bool read_wire_bytes(const char *prefix, uint64_t *tx, uint64_t *rx)
+{
+    FILE *file = fopen("/proc/net/dev", "r");
+    if (file == NULL)
+    {
+        return false;
+    }
+    char line[256];
+    size_t found = 0;
+    const size_t length = strlen(prefix);
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        char *name = line + strspn(line, " ");
+        char *colon = strchr(name, ':');
+        char *end;
+        if (colon == NULL || strncmp(name, prefix, length) != 0)
+        {
+            continue;
+        }
+        size_t i = strtoul(name + length, &end, 10);
+        if (end != colon || i >= node_count)
+        {
+            continue;
+        }
+        /* What the bridge side receives, the node sent */
+        uint64_t bridge_rx;
+        uint64_t bridge_tx;
+        if (sscanf(colon + 1, "%" SCNu64 " %*u %*u %*u %*u %*u %*u %*u %" SCNu64, &bridge_rx, &bridge_tx) == 2)
+        {
+            tx[i] = bridge_rx;
+            rx[i] = bridge_tx;
+            ++found;
+        }
+    }
+    (void)fclose(file);
+    return found == node_count;
+}
+
+static bool at_floor(const load_node_t *node, uint8_t *floor)
+{
+    double nearest = round(node->position);
+    *floor = (uint8_t)nearest;
+    return fabs(node->position - nearest) <= LOAD_SENSOR_WIDTH;
+}
+
+static bool button_pressed(size_t i, uint8_t button, uint8_t floor, int64_t elapsed)
+{
+    for (size_t p = 0; p < passenger_count; ++p)
+    {
+        const passenger_t *passenger = &passengers[p];
+        if (passenger->arrival > elapsed || passenger->delivered != 0)
+        {
+            continue;
+        }
+        if (button == 2)
+        {
+            if (passenger->car == (int8_t)i && passenger->to == floor)
+            {
+                return true;
+            }
+        }
+        else if (passenger->car == -1 && passenger->panel == i && passenger->from == floor &&
+                 (passenger->to > passenger->from) == (button == 0))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Answers a request of the elevator of node @p i
+ *
+ * @param i node index
+ * @param elapsed time since the start of the workload, negative during the warmup
+ */
+static void handle_packet(size_t i, int64_t elapsed)
+{
+    load_node_t *node = &nodes[i];
+    const uint8_t *packet = node->packet;
+    uint8_t reply[4] = {packet[0], 0, 0, 0};
+    uint8_t floor;
+
+    switch ((hardware_command_t)packet[0])
+    {
+    case HARDWARE_COMMAND_MOTOR:
+        node->motor = (int8_t)packet[1];
+        return;
+    case HARDWARE_COMMAND_DOOR_LAMP:
+        node->door = packet[1] != 0;
+        return;
+    case HARDWARE_COMMAND_ORDER_BUTTON:
+        reply[1] = button_pressed(i, packet[1], packet[2], elapsed);
+        break;
+    case HARDWARE_COMMAND_FLOOR_SENSOR:
+        if (at_floor(node, &floor))
+        {
+            reply[1] = 1;
+            reply[2] = floor;
+        }
+        break;
+    case HARDWARE_COMMAND_STOP_BUTTON:
+    case HARDWARE_COMMAND_OBSTRUCTION:
+        break;
+    default:
+        return;
+    }
+    if (send(node->client_fd, reply, sizeof(reply), MSG_NOSIGNAL) != sizeof(reply))
+    {
+        (void)close(node->client_fd);
+        node->client_fd = -1;
+    }
+}
+
+static void receive_packets(size_t i, int64_t elapsed)
+{
+    load_node_t *node = &nodes[i];
+    while (node->client_fd != -1)
+    {
+        ssize_t length = recv(node->client_fd, node->packet + node->received, sizeof(node->packet) - node->received,
+                              MSG_DONTWAIT);
+        if (length == -1 && (errno == EAGAIN || errno == EINTR))
+        {
+            return;
+        }
+        if (length <= 0)
+        {
+            (void)close(node->client_fd);
+            node->client_fd = -1;
+            node->received = 0;
+            return;
+        }
+        node->received += length;
+        if (node->received == sizeof(node->packet))
+        {
+            handle_packet(i, elapsed);
+            node->received = 0;
+        }
+    }
+}
+
+/**
+ * @brief Moves the cars and lets passengers board and leave cars that have their door open at a floor
+ *
+ * @param delta time since the last update in nanoseconds
+ * @param elapsed time since the start of the workload, negative during the warmup
+ * @param now monotonic time
+ */
+static void update_world(int64_t delta, int64_t elapsed, int64_t now)
+{
+    for (size_t i = 0; i < node_count; ++i)
+    {
+        load_node_t *node = &nodes[i];
+        node->position += node->motor * (double)delta / LOAD_FLOOR_TIME_NSEC;
+        node->position = fmin(fmax(node->position, 0), FLOOR_COUNT - 1);
+    }
+
+    for (size_t p = 0; p < passenger_count; ++p)
+    {
+        passenger_t *passenger = &passengers[p];
+        if (passenger->arrival > elapsed || passenger->delivered != 0)
+        {
+            continue;
+        }
+        for (size_t i = 0; i < node_count; ++i)
+        {
+            uint8_t floor;
+            if (!nodes[i].door || !at_floor(&nodes[i], &floor))
+            {
+                continue;
+            }
+            if (passenger->car == -1 && passenger->from == floor)
+            {
+                passenger->car = (int8_t)i;
+                passenger->boarded = now;
+                break;
+            }
+            if (passenger->car == (int8_t)i && passenger->to == floor)
+            {
+                passenger->delivered = now;
+                break;
+            }
+        }
+    }
+}
+
+static int compare_durations(const void *a, const void *b)
+{
+    const int64_t x = *(const int64_t *)a;
+    const int64_t y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void print_percentiles(const char *name, int64_t *durations, size_t count)
+{
+    if (count == 0)
+    {
+        printf("%-10s %9s %9s %9s %9s\n", name, "-", "-", "-", "-");
+        return;
+    }
+    qsort(durations, count, sizeof(*durations), compare_durations);
+    printf("%-10s %9.2f %9.2f %9.2f %9.2f\n", name, durations[count * 50 / 100] / 1e9,
+           durations[count * 90 / 100] / 1e9, durations[count * 99 / 100] / 1e9, durations[count - 1] / 1e9);
+}
+
+static void print_report(int64_t start, int64_t end, bool wire)
+{
+    const double seconds = (end - start) / 1e9;
+    const long ticks = sysconf(_SC_CLK_TCK);
+
+    printf("%-5s %-8s %7s %12s %12s\n", "NODE", "PID", "CPU %", "WIRE TX kB", "WIRE RX kB");
+    for (size_t i = 0; i < node_count; ++i)
+    {
+        char tx[16] = "-";
+        char rx[16] = "-";
+        if (wire)
+        {
+            (void)snprintf(tx, sizeof(tx), "%.1f", nodes[i].wire_tx / 1e3);
+            (void)snprintf(rx, sizeof(rx), "%.1f", nodes[i].wire_rx / 1e3);
+        }
+        printf("%-5zu %-8d %7.2f %12s %12s\n", i, (int)nodes[i].pid, 100.0 * nodes[i].cpu_ticks / ticks / seconds, tx,
+               rx);
+    }
+
+    int64_t *waits = calloc(passenger_count + 1, sizeof(int64_t));
+    int64_t *trips = calloc(passenger_count + 1, sizeof(int64_t));
+    size_t boarded = 0;
+    size_t delivered = 0;
+    size_t arrived = 0;
+    for (size_t p = 0; p < passenger_count; ++p)
+    {
+        const passenger_t *passenger = &passengers[p];
+        arrived += start + passenger->arrival <= end;
+        if (passenger->boarded != 0)
+        {
+            waits[boarded++] = passenger->boarded - (start + passenger->arrival);
+        }
+        if (passenger->delivered != 0)
+        {
+            trips[delivered++] = passenger->delivered - (start + passenger->arrival);
+        }
+    }
+
+    printf("\n%zu passengers arrived in %.0f s, %zu delivered, %zu riding, %zu waiting\n", arrived, seconds, delivered,
+           boarded - delivered, arrived - boarded);
+    printf("Throughput %.1f passengers/min\n\n", delivered * 60.0 / seconds);
+    printf("%-10s %9s %9s %9s %9s\n", "TIME s", "P50", "P90", "P99", "MAX");
+    print_percentiles("wait", waits, boarded);
+    print_percentiles("trip", trips, delivered);
+    free(waits);
+    free(trips);
+}
+
+int main(int argc, char **argv)
+{
+    const char *binary = "./elevator";
+    const char *netns = NULL;
+    const char *veth = "veth-el";
+    const char *script = NULL;
+    const char *directory = NULL;
+    double duration = 60;
+    double rate = 10;
+    uint64_t seed = 1;
+    int option;
+    while ((option = getopt(argc, argv, "n:d:r:s:w:e:N:v:o:")) != -1)
+    {
+        switch (option)
+        {
+        case 'n':
+            /* Number of nodes, elevator 0 to n - 1 */
+            node_count = strtoul(optarg, NULL, 10);
+            break;
+        case 'd':
+            /* Length of the workload in seconds, after the warmup */
+            duration = atof(optarg);
+            break;
+        case 'r':
+            /* Mean passenger arrivals per minute */
+            rate = atof(optarg);
+            break;
+        case 's':
+            /* Seed of the generated workload */
+            seed = strtoull(optarg, NULL, 10);
+            break;
+        case 'w':
+            /* Scripted workload instead of a generated one */
+            script = optarg;
+            break;
+        case 'e':
+            /* Elevator executable */
+            binary = optarg;
+            break;
+        case 'N':
+            /* Path prefix of the network namespaces of the nodes, the node index is appended */
+            netns = optarg;
+            break;
+        case 'v':
+            /* Name prefix of the bridge side of the veth pairs of the nodes */
+            veth = optarg;
+            break;
+        case 'o':
+            /* Directory for the working directories and logs of the nodes. Without it the logs are discarded */
+            directory = optarg;
+            break;
+        default:
+            fprintf(stderr,
+                    "usage: %s [-n nodes] [-d seconds] [-r arrivals/min] [-s seed] [-w script] [-e elevator] "
+                    "[-N netns prefix] [-v veth prefix] [-o directory]\n",
+                    argv[0]);
+            return -EINVAL;
+        }
+    }
+    if (node_count == 0 || node_count > ELEVATOR_COUNT || duration <= 0 || rate <= 0)
+    {
+        fprintf(stderr, "Invalid node count, duration or rate\n");
+        return -EINVAL;
+    }
+
+    char path[PATH_MAX];
+    if (realpath(binary, path) == NULL)
+    {
+        fprintf(stderr, "Could not find %s, err = %d\n", binary, errno);
+        return -errno;
+    }
+    char temporary[] = "/tmp/elevator-load-XXXXXX";
+    const bool log = directory != NULL;
+    if (directory == NULL && (directory = mkdtemp(temporary)) == NULL)
+    {
+        fprintf(stderr, "Could not create a directory for the nodes, err = %d\n", errno);
+        return -errno;
+    }
+    if (mkdir(directory, 0755) == -1 && errno != EEXIST)
+    {
+        fprintf(stderr, "Could not create %s, err = %d\n", directory, errno);
+        return -errno;
+    }
+
+    passengers = calloc(LOAD_MAX_PASSENGERS, sizeof(passenger_t));
+    if (passengers == NULL)
+    {
+        return -ENOMEM;
+    }
+    const int64_t workload = (int64_t)(duration * 1e9);
+    if (script != NULL)
+    {
+        int err = read_script(script);
+        if (err < 0)
+        {
+            fprintf(stderr, "Could not read %s, err = %d\n", script, -err);
+            return err;
+        }
+    }
+    else
+    {
+        generate_passengers(rate, workload, seed);
+    }
+
+    for (size_t i = 0; i < node_count; ++i)
+    {
+        if (open_hardware(i, netns) < 0)
+        {
+            return -EIO;
+        }
+    }
+    for (size_t i = 0; i < node_count; ++i)
+    {
+        if (start_node(i, path, netns, directory, log) < 0)
+        {
+            return -EIO;
+        }
+    }
+    (void)signal(SIGINT, on_interrupt);
+    (void)signal(SIGTERM, on_interrupt);
+    printf("Started %zu nodes, %zu passengers over %.0f s, working directories in %s\n", node_count, passenger_count,
+           duration, directory);
+    fflush(stdout);
+
+    struct pollfd fds[2 * ELEVATOR_COUNT];
+    const int64_t start = monotonic_nsec() + LOAD_WARMUP_NSEC;
+    int64_t last = monotonic_nsec();
+    uint64_t wire_tx[ELEVATOR_COUNT] = {0};
+    uint64_t wire_rx[ELEVATOR_COUNT] = {0};
+    bool started = false;
+    bool wire = false;
+    int64_t now = last;
+
+    while (!interrupted && now < start + workload)
+    {
+        for (size_t i = 0; i < node_count; ++i)
+        {
+            fds[2 * i] = (struct pollfd){.fd = nodes[i].listen_fd, .events = POLLIN};
+            fds[2 * i + 1] = (struct pollfd){.fd = nodes[i].client_fd, .events = POLLIN};
+        }
+        (void)poll(fds, 2 * node_count, LOAD_POLL_TIMEOUT_MS);
+
+        now = monotonic_nsec();
+        update_world(now - last, now - start, now);
+        last = now;
+
+        if (!started && now >= start)
+        {
+            /* CPU time and traffic are counted from the start of the workload */
+            started = true;
+            wire = read_wire_bytes(veth, wire_tx, wire_rx);
+            for (size_t i = 0; i < node_count; ++i)
+            {
+                nodes[i].cpu_ticks = read_cpu_ticks(nodes[i].pid);
+                nodes[i].wire_tx = wire_tx[i];
+                nodes[i].wire_rx = wire_rx[i];
+            }
+        }
+
+        for (size_t i = 0; i < node_count; ++i)
+        {
+            if (fds[2 * i].revents & POLLIN)
+            {
+                /* A reconnecting node replaces its previous connection */
+                int fd = accept4(nodes[i].listen_fd, NULL, NULL, SOCK_CLOEXEC);
+                if (fd != -1)
+                {
+                    int nodelay = 1;
+                    (void)setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+                    (void)close(nodes[i].client_fd);
+                    nodes[i].client_fd = fd;
+                    nodes[i].received = 0;
+                }
+            }
+            receive_packets(i, now - start);
+        }
+    }
+
+    const int64_t end = monotonic_nsec();
+    if (wire)
+    {
+        wire = read_wire_bytes(veth, wire_tx, wire_rx);
+    }
+    for (size_t i = 0; i < node_count; ++i)
+    {
+        nodes[i].cpu_ticks = read_cpu_ticks(nodes[i].pid) - nodes[i].cpu_ticks;
+        nodes[i].wire_tx = wire_tx[i] - nodes[i].wire_tx;
+        nodes[i].wire_rx = wire_rx[i] - nodes[i].wire_rx;
+        (void)kill(-nodes[i].pid, SIGKILL);
+        (void)waitpid(nodes[i].pid, NULL, 0);
+    }
+    if (!started)
+    {
+        fprintf(stderr, "Interrupted during the warmup\n");
+        return -EINTR;
+    }
+    print_report(start, end, wire);
+    return 0;
+}
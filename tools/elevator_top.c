@@ -0,0 +1,203 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <orders.h>
+#include <stats.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TOP_STALE_NSEC (1000000000LL) // Processes without a loop iteration for this long are shown as stalled
+
+typedef struct
+{
+    const stats_segment_t *segment;
+    int32_t pid; // Process the counters below were read from
+    uint64_t loop_count;
+    uint64_t datagrams_in;
+    uint64_t datagrams_out;
+} top_node_t;
+
+static const char *state_names[] = {"idle", "moving", "open"};
+
+static int64_t monotonic_nsec(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (int64_t)time.tv_sec * 1000000000LL + time.tv_nsec;
+}
+
+static void rebaseline(top_node_t *node)
+{
+    node->pid = node->segment->pid;
+    node->loop_count = node->segment->loop_count;
+    node->datagrams_in = node->segment->datagrams_in;
+    node->datagrams_out = node->segment->datagrams_out;
+}
+
+static void map_segments(top_node_t *nodes)
+{
+    /* Segments are looked up again on every refresh, since nodes may start after elevator-top */
+    for (size_t i = 0; i < ELEVATOR_COUNT; ++i)
+    {
+        if (nodes[i].segment != NULL)
+        {
+            continue;
+        }
+        char name[32];
+        (void)snprintf(name, sizeof(name), STATS_NAME_FORMAT, i);
+        int fd = shm_open(name, O_RDONLY, 0);
+        if (fd == -1)
+        {
+            continue;
+        }
+        const stats_segment_t *segment = mmap(NULL, sizeof(stats_segment_t), PROT_READ, MAP_SHARED, fd, 0);
+        (void)close(fd);
+        if ((void *)segment == MAP_FAILED)
+        {
+            continue;
+        }
+        if (segment->magic != STATS_MAGIC || segment->version != STATS_VERSION || segment->first_index != i)
+        {
+            (void)munmap((void *)segment, sizeof(stats_segment_t));
+            continue;
+        }
+        nodes[i].segment = segment;
+    }
+}
+
+static void print(top_node_t *nodes, const double interval, const bool clear)
+{
+    const int64_t now = monotonic_nsec();
+    uint64_t total_in = 0;
+    uint64_t total_out = 0;
+    size_t live = 0;
+    unsigned hall_calls = 0;
+
+    if (clear)
+    {
+        printf("\033[H\033[2J");
+    }
+    printf("%-5s %-8s %-8s %9s %9s %9s %9s %9s %9s\n", "NODE", "PID", "STATUS", "LOOP/S", "LOOP us", "MAX us",
+           "DGRAM IN", "DGRAM OUT", "WAKE us");
+    for (size_t i = 0; i < ELEVATOR_COUNT; ++i)
+    {
+        const stats_segment_t *segment = nodes[i].segment;
+        if (segment == NULL)
+        {
+            continue;
+        }
+        /* A restarted node starts its counters over, its rates are measured from this refresh on */
+        if (segment->pid != nodes[i].pid || segment->loop_count < nodes[i].loop_count ||
+            segment->datagrams_in < nodes[i].datagrams_in || segment->datagrams_out < nodes[i].datagrams_out)
+        {
+            rebaseline(&nodes[i]);
+        }
+        /* Copy the counters once, the process keeps writing while they are read */
+        const uint64_t loop_count = segment->loop_count;
+        const uint64_t datagrams_in = segment->datagrams_in;
+        const uint64_t datagrams_out = segment->datagrams_out;
+        const bool stalled = now - segment->heartbeat_ns > TOP_STALE_NSEC;
+        live += !stalled;
+        total_in += datagrams_in - nodes[i].datagrams_in;
+        total_out += datagrams_out - nodes[i].datagrams_out;
+
+        /* Worst wake-up latency, only measured in real-time mode */
+        char wakeup[16] = "-";
+        if (segment->wakeup_latency_max_ns > 0)
+        {
+            (void)snprintf(wakeup, sizeof(wakeup), "%.1f", segment->wakeup_latency_max_ns / 1e3);
+        }
+        printf("%-5zu %-8" PRId32 " %-8s %9.0f %9.1f %9.1f %9.0f %9.0f %9s\n", i, segment->pid,
+               stalled ? "stalled" : "running", (loop_count - nodes[i].loop_count) / interval, segment->loop_ns / 1e3,
+               segment->loop_max_ns / 1e3, (datagrams_in - nodes[i].datagrams_in) / interval,
+               (datagrams_out - nodes[i].datagrams_out) / interval, wakeup);
+        nodes[i].loop_count = loop_count;
+        nodes[i].datagrams_in = datagrams_in;
+        nodes[i].datagrams_out = datagrams_out;
+    }
+
+    printf("\n%-5s %-7s %5s %6s %4s %8s %4s %5s %5s %9s %9s\n", "ELEV", "STATE", "FLOOR", "TARGET", "DIR", "DISABLED",
+           "HALL", "CAB", "PEERS", "RTT us", "MAX us");
+    for (size_t i = 0; i < ELEVATOR_COUNT; ++i)
+    {
+        const stats_segment_t *segment = nodes[i].segment;
+        if (segment == NULL)
+        {
+            continue;
+        }
+        for (size_t j = segment->first_index; j < (size_t)segment->first_index + segment->count && j < ELEVATOR_COUNT;
+             ++j)
+        {
+            const stats_elevator_t *elevator = &segment->elevators[j];
+            const uint8_t state = elevator->state;
+            hall_calls = elevator->hall_calls > hall_calls ? elevator->hall_calls : hall_calls;
+            printf("%-5zu %-7s %5u %6u %4s %8s %4u %5u %5u %9.1f %9.1f\n", j,
+                   state < sizeof(state_names) / sizeof(state_names[0]) ? state_names[state] : "?",
+                   elevator->current_floor, elevator->target_floor,
+                   elevator->direction == ELEVATOR_DIRECTION_UP ? "up" : "down", elevator->disabled ? "yes" : "no",
+                   elevator->hall_calls, elevator->cab_calls, elevator->connected_peers, elevator->driver_rtt_ns / 1e3,
+                   elevator->driver_rtt_max_ns / 1e3);
+        }
+    }
+
+    printf("\n%zu running, %.0f datagrams/s in, %.0f datagrams/s out, %u hall calls\n", live, total_in / interval,
+           total_out / interval, hall_calls);
+    fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+    double interval = 1.0;
+    bool once = false;
+    int option;
+    while ((option = getopt(argc, argv, "n:1")) != -1)
+    {
+        switch (option)
+        {
+        case 'n':
+            /* Refresh interval in seconds */
+            interval = atof(optarg);
+            break;
+        case '1':
+            /* Print a single refresh and exit */
+            once = true;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n interval] [-1]\n", argv[0]);
+            return -EINVAL;
+        }
+    }
+    if (interval <= 0)
+    {
+        fprintf(stderr, "Invalid interval\n");
+        return -EINVAL;
+    }
+
+    top_node_t nodes[ELEVATOR_COUNT] = {0};
+    map_segments(nodes);
+    /* Rates are differences between two refreshes, so the first one only sets the baseline */
+    for (size_t i = 0; i < ELEVATOR_COUNT; ++i)
+    {
+        if (nodes[i].segment != NULL)
+        {
+            rebaseline(&nodes[i]);
+        }
+    }
+
+    while (1)
+    {
+        struct timespec delay = {.tv_sec = (time_t)interval, .tv_nsec = (long)((interval - (time_t)interval) * 1e9)};
+        (void)nanosleep(&delay, NULL);
+        print(nodes, interval, !once);
+        if (once)
+        {
+            return 0;
+        }
+        map_segments(nodes);
+    }
+}
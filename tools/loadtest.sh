@@ -0,0 +1,40 @@
+#!/bin/sh
+# Runs elevator-load with every node in its own network namespace. The nodes are connected to a bridge by veth pairs
+# and have the addresses 10.42.0.<index + 1>/24. Everything is created in a new user, network and mount namespace,
+# so no privileges are needed where unprivileged user namespaces are permitted, and nothing is left behind.
+#
+# usage: loadtest.sh [elevator-load options], run from the build directory
+set -eu
+
+if [ -z "${LOADTEST_NAMESPACE:-}" ]; then
+    LOADTEST_NAMESPACE=1 exec unshare --user --map-root-user --net --mount "$0" "$@"
+fi
+
+NODES=3
+while getopts "n:d:r:s:w:e:N:v:o:" option; do
+    if [ "$option" = n ]; then
+        NODES=$OPTARG
+    fi
+done
+
+BUILD=$(cd "$(dirname "$0")/.." && pwd)
+mount -t tmpfs tmpfs /run
+mkdir -p /run/netns
+ip link set lo up
+ip link add br-el type bridge
+ip link set br-el up
+
+i=0
+while [ "$i" -lt "$NODES" ]; do
+    ip netns add "elevator-$i"
+    ip link add "veth-el$i" type veth peer name eth0 netns "elevator-$i"
+    ip link set "veth-el$i" master br-el up
+    ip -n "elevator-$i" link set lo up
+    ip -n "elevator-$i" addr add "10.42.0.$((i + 1))/24" dev eth0
+    ip -n "elevator-$i" link set eth0 up
+    # Seeds are announced to the limited broadcast address, which needs a route
+    ip -n "elevator-$i" route add default dev eth0
+    i=$((i + 1))
+done
+
+exec "$BUILD/tools/elevator-load" -N /run/netns/elevator- -v veth-el -e "$BUILD/elevator" "$@"